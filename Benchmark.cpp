@@ -0,0 +1,464 @@
+#include "Benchmark.h"
+
+#include "rtweekend.h"
+#include "bvh.h"
+#include "camera.h"
+#include "integrator.h"
+#include "obj_loader.h"
+#include "scenes.h"
+#include "sphere_soup.h"
+#include "triangle_mesh.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+	using bench_clock = std::chrono::steady_clock;
+
+	double seconds_since(bench_clock::time_point start) {
+		return std::chrono::duration<double>(bench_clock::now() - start).count();
+	}
+
+	// What a closest-hit query found, to compare two structures ray by ray.
+	struct hit_summary {
+		bool hit = false;
+		real t = 0;
+		bool front_face = false;
+		vec3 normal;
+		bool operator==(const hit_summary& other) const {
+			if (hit != other.hit) return false;
+			return !hit || (t == other.t && front_face == other.front_face
+				&& normal.x() == other.normal.x() && normal.y() == other.normal.y() && normal.z() == other.normal.z());
+		}
+	};
+
+	// Traces every ray against the world and records what it hit.
+	std::vector<hit_summary> trace_all(const hittable& world, const std::vector<ray>& rays, double& seconds) {
+		std::vector<hit_summary> hits(rays.size());
+		hit_record rec;
+		auto start = bench_clock::now();
+		for (size_t i = 0; i < rays.size(); ++i) {
+			if (!world.hit(rays[i], 0.001, infinity, rec)) continue;
+			hits[i].hit = true;
+			hits[i].t = rec.t;
+			hits[i].front_face = rec.front_face;
+			hits[i].normal = rec.normal;
+		}
+		seconds = seconds_since(start);
+		return hits;
+	}
+
+	size_t count_differences(const std::vector<hit_summary>& a, const std::vector<hit_summary>& b) {
+		size_t differences = 0;
+		for (size_t i = 0; i < a.size(); ++i)
+			if (!(a[i] == b[i])) differences++;
+		return differences;
+	}
+
+	// Returns false if a structure answered any ray differently from the list.
+	bool benchmark_scene(const std::string& name, const hittable_list& list) {
+		const auto aspect_ratio = 3.0 / 2.0;
+		const int image_width = 300;
+		const int image_height = static_cast<int>(image_width / aspect_ratio);
+		camera cam(point3(13, 2, 3), point3(0, 0, 0), vec3(0, 1, 0), 20, aspect_ratio, 0.6, 10.0);
+
+		auto build_start = bench_clock::now();
+		bvh_node bvh(list);
+		double build_seconds = seconds_since(build_start);
+		bvh_node soup_bvh(list, sphere_soup::lane_width);
+
+		auto materials = make_shared<material_table>();
+		material_table_builder material_ids(*materials);
+		sphere_soup soup(materials);
+		for (const auto& object : list.objects) {
+			auto s = std::dynamic_pointer_cast<sphere>(object);
+			if (s) soup.add(s->center, s->radius, material_ids.add(s->mat_ptr.get()));
+		}
+
+		// Primary rays plus one diffuse bounce from every primary hit, so
+		// both coherent and incoherent queries are measured.
+		std::vector<ray> rays;
+		rays.reserve(2 * image_width * image_height);
+		for (int j = 0; j < image_height; ++j) {
+			for (int i = 0; i < image_width; ++i) {
+				sampler rng(static_cast<uint64_t>(j) * image_width + i, 0);
+				auto u = (i + random_double(rng)) / (image_width - 1);
+				auto v = (j + random_double(rng)) / (image_height - 1);
+				rays.push_back(cam.get_ray(u, v, rng));
+			}
+		}
+		size_t primary_count = rays.size();
+		hit_record rec;
+		for (size_t i = 0; i < primary_count; ++i) {
+			sampler rng(i, 1);
+			if (bvh.hit(rays[i], 0.001, infinity, rec))
+				rays.push_back(ray(rec.p, rec.normal + random_unit_vector(rng)));
+		}
+
+		double list_seconds = 0.0;
+		double bvh_seconds = 0.0;
+		double soup_seconds = 0.0;
+		double soup_bvh_seconds = 0.0;
+		std::vector<hit_summary> list_hits = trace_all(list, rays, list_seconds);
+		std::vector<hit_summary> bvh_hits = trace_all(bvh, rays, bvh_seconds);
+		std::vector<hit_summary> soup_hits = trace_all(soup, rays, soup_seconds);
+		std::vector<hit_summary> soup_bvh_hits = trace_all(soup_bvh, rays, soup_bvh_seconds);
+
+		std::cerr << name << ": " << list.objects.size() << " objects, " << rays.size() << " rays\n"
+			<< "  bvh build:     " << build_seconds * 1000.0 << " ms\n"
+			<< "  hittable_list: " << list_seconds * 1000.0 << " ms (" << rays.size() / list_seconds / 1e6 << " Mrays/s)\n"
+			<< "  bvh_node:      " << bvh_seconds * 1000.0 << " ms (" << rays.size() / bvh_seconds / 1e6 << " Mrays/s)\n"
+			<< "  speedup:       " << list_seconds / bvh_seconds << "x\n"
+			<< "  sphere_soup (" << sphere_soup::lane_width << " lanes):      " << soup_seconds * 1000.0 << " ms (" << rays.size() / soup_seconds / 1e6 << " Mrays/s)\n"
+			<< "  bvh_node + soup leaves: " << soup_bvh_seconds * 1000.0 << " ms (" << rays.size() / soup_bvh_seconds / 1e6 << " Mrays/s)\n";
+
+		// Every structure runs the same exact sphere test on the closest
+		// sphere, so t, facing and normal must match the list's bit for bit.
+		bool matched = true;
+		auto check = [&](const char* structure, const std::vector<hit_summary>& hits) {
+			size_t differences = count_differences(list_hits, hits);
+			if (differences == 0) return;
+			std::cerr << "  MISMATCH: " << structure << " answered " << differences << " rays differently from hittable_list\n";
+			matched = false;
+		};
+		check("bvh_node", bvh_hits);
+		check("sphere_soup", soup_hits);
+		check("bvh_node + soup leaves", soup_bvh_hits);
+		return matched;
+	}
+}
+
+bool RunBVHBenchmark()
+{
+	// The book's hollow glass ball: a sphere of negative radius inside the
+	// glass one, whose normals point inwards.
+	hittable_list hollow = book_scene();
+	scene_arena& arena = hollow.arena();
+	hollow.add(arena.make<sphere>(point3(0, 1, 0), -0.9, arena.make<dielectric>(1.5)));
+
+	bool matched = benchmark_scene("book_scene", book_scene());
+	matched = benchmark_scene("random_scene", random_scene()) && matched;
+	matched = benchmark_scene("book_scene with a hollow glass ball", hollow) && matched;
+	return matched;
+}
+
+bool RunMeshBenchmark(const char* path)
+{
+	auto load_start = bench_clock::now();
+	std::vector<point3> vertices;
+	std::vector<uint32_t> indices;
+	std::string error;
+	if (!load_obj(path, vertices, indices, error)) {
+		std::cerr << error << "\n";
+		return false;
+	}
+	double load_seconds = seconds_since(load_start);
+	size_t vertex_count = vertices.size();
+
+	auto build_start = bench_clock::now();
+	triangle_mesh mesh(std::move(vertices), std::move(indices), make_shared<lambertian>(color(0.5, 0.5, 0.5)));
+	double build_seconds = seconds_since(build_start);
+	aabb bounds;
+	if (!mesh.bounding_box(bounds)) {
+		std::cerr << path << " has no faces.\n";
+		return false;
+	}
+
+	// Frame the bounds from a diagonal, like the other benchmarks' camera.
+	const auto aspect_ratio = 3.0 / 2.0;
+	const int image_width = 300;
+	const int image_height = static_cast<int>(image_width / aspect_ratio);
+	point3 center = bounds.centroid();
+	real radius = (bounds.max() - bounds.min()).length() / 2;
+	camera cam(center + vec3(1, 0.5, 1.5) * (2 * radius), center, vec3(0, 1, 0), 40, aspect_ratio, 0.0, 1.0);
+
+	std::vector<ray> rays;
+	rays.reserve(2 * image_width * image_height);
+	for (int j = 0; j < image_height; ++j) {
+		for (int i = 0; i < image_width; ++i) {
+			sampler rng(static_cast<uint64_t>(j) * image_width + i, 0);
+			auto u = (i + random_double(rng)) / (image_width - 1);
+			auto v = (j + random_double(rng)) / (image_height - 1);
+			rays.push_back(cam.get_ray(u, v, rng));
+		}
+	}
+	size_t primary_count = rays.size();
+	hit_record rec;
+	for (size_t i = 0; i < primary_count; ++i) {
+		sampler rng(i, 1);
+		if (mesh.hit(rays[i], 0.001, infinity, rec))
+			rays.push_back(ray(rec.p, rec.normal + random_unit_vector(rng)));
+	}
+	double trace_seconds = 0.0;
+	std::vector<hit_summary> results = trace_all(mesh, rays, trace_seconds);
+	const size_t hits = std::count_if(results.begin(), results.end(), [](const hit_summary& h) { return h.hit; });
+
+	const size_t probe_count = 100000;
+	size_t escaped = 0;
+	for (size_t i = 0; i < probe_count; ++i) {
+		sampler rng(i, 2);
+		if (!mesh.hit(ray(center, random_unit_vector(rng)), 0, infinity, rec)) escaped++;
+	}
+
+	std::cerr << path << ": " << vertex_count << " vertices, " << mesh.triangle_count() << " triangles\n"
+		<< "  load:      " << load_seconds * 1000.0 << " ms\n"
+		<< "  bvh build: " << build_seconds * 1000.0 << " ms\n"
+		<< "  trace:     " << rays.size() << " rays, " << hits << " hits, " << trace_seconds * 1000.0 << " ms ("
+		<< rays.size() / trace_seconds / 1e6 << " Mrays/s)\n"
+		<< "  escaped from the center: " << escaped << " of " << probe_count << " rays\n";
+	return true;
+}
+
+namespace {
+	struct integrator_image {
+		int width;
+		int height;
+		camera cam;
+		const hittable* world;
+	};
+
+	// Adds one sample per pixel with the given sample index to accum.
+	void render_pass(const integrator_image& img, const integrator_settings& settings, int sample_index, uint64_t seed, std::vector<color>& accum) {
+		for (int j = 0; j < img.height; ++j) {
+			for (int i = 0; i < img.width; ++i) {
+				sampler rng(static_cast<uint64_t>(j) * img.width + i, sample_index, seed);
+				auto u = (i + random_double(rng)) / (img.width - 1);
+				auto v = (j + random_double(rng)) / (img.height - 1);
+				accum[j * img.width + i] += ray_color(img.cam.get_ray(u, v, rng), *img.world, settings, rng);
+			}
+		}
+	}
+
+	// Error of the gamma corrected, clamped pixel values that end up in the image.
+	double mean_squared_error(const std::vector<color>& image, int image_samples, const std::vector<color>& reference, int reference_samples) {
+		double sum = 0.0;
+		for (size_t p = 0; p < image.size(); ++p) {
+			for (int c = 0; c < 3; ++c) {
+				double a = clamp(sqrt(image[p][c] / image_samples), 0.0, 1.0);
+				double b = clamp(sqrt(reference[p][c] / reference_samples), 0.0, 1.0);
+				sum += (a - b) * (a - b);
+			}
+		}
+		return sum / (3.0 * image.size());
+	}
+}
+
+void RunIntegratorBenchmark()
+{
+	const auto aspect_ratio = 3.0 / 2.0;
+	const int image_width = 80;
+	const int image_height = static_cast<int>(image_width / aspect_ratio);
+	const int reference_samples = 1024;
+	const double time_budget = 2.0;
+
+	bvh_node world(book_scene());
+	integrator_image img{ image_width, image_height,
+		camera(point3(13, 2, 3), point3(0, 0, 0), vec3(0, 1, 0), 20, aspect_ratio, 0.6, 10.0), &world };
+
+	// The reference uses a different seed so its noise is independent of the runs below.
+	integrator_settings reference_settings;
+	reference_settings.russian_roulette = false;
+	std::vector<color> reference(image_width * image_height);
+	auto reference_start = bench_clock::now();
+	for (int s = 0; s < reference_samples; ++s)
+		render_pass(img, reference_settings, s, 1, reference);
+	std::cerr << "reference: " << reference_samples << " spp, depth 50, no roulette, "
+		<< seconds_since(reference_start) << " s\n";
+
+	struct config { const char* name; int min_bounces; int max_depth; bool russian_roulette; };
+	const config configs[] = {
+		{ "depth 6, no roulette", 0, 6, false },
+		{ "depth 50, no roulette", 0, 50, false },
+		{ "depth 50, roulette after 3", 3, 50, true },
+		{ "depth 50, roulette after 1", 1, 50, true },
+	};
+
+	for (const auto& c : configs) {
+		integrator_settings settings;
+		settings.min_bounces = c.min_bounces;
+		settings.max_depth = c.max_depth;
+		settings.russian_roulette = c.russian_roulette;
+
+		std::vector<color> accum(image_width * image_height);
+		int samples = 0;
+		auto start = bench_clock::now();
+		while (seconds_since(start) < time_budget)
+			render_pass(img, settings, samples++, 0, accum);
+		double seconds = seconds_since(start);
+
+		std::cerr << c.name << ": " << samples << " spp in " << seconds << " s, "
+			<< samples * static_cast<double>(accum.size()) / seconds / 1e3 << " ksamples/s, MSE "
+			<< mean_squared_error(accum, samples, reference, reference_samples) << "\n";
+	}
+}
+
+namespace {
+	// Runs body(thread_index) on thread_count threads and returns the wall time.
+	template <typename Body>
+	double run_threads(int thread_count, Body body) {
+		std::vector<std::thread> threads;
+		auto start = bench_clock::now();
+		for (int t = 0; t < thread_count; ++t)
+			threads.emplace_back(body, t);
+		for (auto& thread : threads)
+			thread.join();
+		return seconds_since(start);
+	}
+}
+
+void RunHitScalingBenchmark()
+{
+	const int rays_per_thread = 400000;
+	const int max_threads = std::max(1u, std::thread::hardware_concurrency());
+
+	bvh_node world(random_scene());
+	camera cam(point3(13, 2, 3), point3(0, 0, 0), vec3(0, 1, 0), 20, 3.0 / 2.0, 0.6, 10.0);
+	// Stands in for the material every ray used to take a reference to.
+	shared_ptr<material> shared_material = make_shared<lambertian>(color(0.5, 0.5, 0.5));
+
+	std::vector<ray> rays(rays_per_thread);
+	for (int i = 0; i < rays_per_thread; ++i) {
+		sampler rng(i, 0);
+		rays[i] = cam.get_ray(random_double(rng), random_double(rng), rng);
+	}
+
+	double base_raw = 0.0;
+	double base_shared = 0.0;
+	for (int threads = 1; threads <= max_threads; threads *= 2) {
+		std::atomic<size_t> sink{ 0 };
+
+		double raw_seconds = run_threads(threads, [&](int) {
+			hit_record rec;
+			size_t hits = 0;
+			for (const auto& r : rays)
+				if (world.hit(r, 0.001, infinity, rec) && rec.mat_ptr != nullptr) hits++;
+			sink += hits;
+		});
+		double shared_seconds = run_threads(threads, [&](int) {
+			hit_record rec;
+			size_t hits = 0;
+			for (const auto& r : rays) {
+				if (world.hit(r, 0.001, infinity, rec)) {
+					// One copy in the primitive, one in the list, as before.
+					shared_ptr<material> in_primitive = shared_material;
+					shared_ptr<material> in_list = in_primitive;
+					if (in_list) hits++;
+				}
+			}
+			sink += hits;
+		});
+
+		double raw_rate = threads * static_cast<double>(rays_per_thread) / raw_seconds;
+		double shared_rate = threads * static_cast<double>(rays_per_thread) / shared_seconds;
+		if (threads == 1) {
+			base_raw = raw_rate;
+			base_shared = shared_rate;
+		}
+		std::cerr << threads << " threads: raw pointer " << raw_rate / 1e6 << " Mrays/s ("
+			<< 100.0 * raw_rate / (base_raw * threads) << "% scaling), shared_ptr copies "
+			<< shared_rate / 1e6 << " Mrays/s (" << 100.0 * shared_rate / (base_shared * threads) << "% scaling)\n";
+	}
+}
+
+namespace {
+	const int precision_image_width = 120;
+	const int precision_samples = 64;
+
+	std::vector<color> render_precision_image(int& width, int& height) {
+		const auto aspect_ratio = 3.0 / 2.0;
+		width = precision_image_width;
+		height = static_cast<int>(width / aspect_ratio);
+
+		// Scene construction draws from rand(), so pin it for a repeatable scene.
+		std::srand(1);
+		bvh_node world(book_scene(), sphere_soup::lane_width);
+		integrator_image img{ width, height,
+			camera(point3(13, 2, 3), point3(0, 0, 0), vec3(0, 1, 0), 20, aspect_ratio, 0.6, 10.0), &world };
+
+		std::vector<color> accum(width * height);
+		integrator_settings settings;
+		for (int s = 0; s < precision_samples; ++s)
+			render_pass(img, settings, s, 0, accum);
+		for (auto& c : accum)
+			c /= precision_samples;
+		return accum;
+	}
+
+	const char* precision_name() {
+		return sizeof(real) == sizeof(float) ? "float" : "double";
+	}
+}
+
+bool WritePrecisionReference(const char* path)
+{
+	int width, height;
+	std::vector<color> image = render_precision_image(width, height);
+
+	// PFM: scanlines run bottom to top, which is the order render_pass stores them in.
+	// A negative scale marks the floats as little endian.
+	std::ofstream out(path, std::ios::binary);
+	if (!out) {
+		std::cerr << "Could not open " << path << " for writing.\n";
+		return false;
+	}
+	out << "PF\n" << width << ' ' << height << "\n-1.0\n";
+	for (const auto& c : image) {
+		float rgb[3] = { static_cast<float>(c.x()), static_cast<float>(c.y()), static_cast<float>(c.z()) };
+		out.write(reinterpret_cast<const char*>(rgb), sizeof(rgb));
+	}
+	std::cerr << "Wrote " << precision_name() << " reference " << width << "x" << height
+		<< " at " << precision_samples << " spp to " << path << "\n";
+	return static_cast<bool>(out);
+}
+
+bool RunPrecisionCheck(const char* path, double min_psnr)
+{
+	std::ifstream in(path, std::ios::binary);
+	std::string magic;
+	int ref_width = 0, ref_height = 0;
+	double scale = 0.0;
+	in >> magic >> ref_width >> ref_height >> scale;
+	in.get();
+	if (!in || magic != "PF" || scale >= 0.0) {
+		std::cerr << "Could not read a little endian RGB PFM from " << path << ".\n";
+		return false;
+	}
+	std::vector<float> reference(3 * static_cast<size_t>(ref_width) * ref_height);
+	in.read(reinterpret_cast<char*>(reference.data()), reference.size() * sizeof(float));
+	if (!in) {
+		std::cerr << path << " is truncated.\n";
+		return false;
+	}
+
+	auto start = bench_clock::now();
+	int width, height;
+	std::vector<color> image = render_precision_image(width, height);
+	double seconds = seconds_since(start);
+	if (width != ref_width || height != ref_height) {
+		std::cerr << "Reference is " << ref_width << "x" << ref_height << ", expected " << width << "x" << height << ".\n";
+		return false;
+	}
+
+	// Compared after gamma correction and clamping, like the written image.
+	double sum = 0.0;
+	for (size_t p = 0; p < image.size(); ++p) {
+		for (int c = 0; c < 3; ++c) {
+			double a = clamp(sqrt(static_cast<double>(image[p][c])), 0.0, 1.0);
+			double b = clamp(sqrt(static_cast<double>(reference[3 * p + c])), 0.0, 1.0);
+			sum += (a - b) * (a - b);
+		}
+	}
+	double mse = sum / (3.0 * image.size());
+	double psnr = mse > 0.0 ? 10.0 * std::log10(1.0 / mse) : infinity;
+	bool passed = psnr >= min_psnr;
+	std::cerr << precision_name() << " render: " << seconds << " s, PSNR " << psnr << " dB against "
+		<< path << " (minimum " << min_psnr << " dB): " << (passed ? "passed" : "FAILED") << "\n";
+	return passed;
+}
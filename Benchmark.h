@@ -0,0 +1,33 @@
+#pragma once
+
+// Times closest-hit queries against a flat hittable_list, a bvh_node and
+// sphere soups built from the same scene, for book_scene(), random_scene()
+// and a book scene with a hollow glass ball. Returns false, after printing
+// a MISMATCH line, if any of them answers a ray differently from the list.
+bool RunBVHBenchmark();
+
+// Renders book_scene() with several integrator settings for the same wall
+// time each and reports samples/sec and mean squared error against a
+// high sample count reference.
+void RunIntegratorBenchmark();
+
+// Loads an OBJ file and reports load and BVH build times and closest-hit
+// throughput for camera rays and one diffuse bounce. Also casts rays from
+// the center of the mesh's bounds and counts those that escape, which
+// should be none for a closed mesh around that point.
+bool RunMeshBenchmark(const char* path);
+
+// Traces the same rays through random_scene() from 1 up to N threads, once
+// with plain hit records and once copying a shared material shared_ptr per
+// hit the way hit_record used to, and reports throughput and scaling.
+void RunHitScalingBenchmark();
+
+// Renders a small fixed view of book_scene() at the build's precision and
+// writes the linear result to a PFM file. Build once in double to make the
+// reference that RunPrecisionCheck compares a float build against.
+bool WritePrecisionReference(const char* path);
+
+// Renders the same view and compares it with the PFM written by
+// WritePrecisionReference. Returns false if the PSNR of the displayed image
+// falls below min_psnr dB.
+bool RunPrecisionCheck(const char* path, double min_psnr);
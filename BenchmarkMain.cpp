@@ -0,0 +1,8 @@
+#include "RenderBenchmark.h"
+
+// Entry point of the rtbench target. Takes the same arguments as
+// RaytracingInOneWeekend --bench-render.
+int main(int argc, char* argv[])
+{
+	return RunRenderBenchmark(argc - 1, argv + 1);
+}
@@ -1,51 +0,0 @@
-#pragma once
-
-#include "Vec3.h"
-
-#include <iostream>
-#include <string>
-
-void write_color(std::ostream& out, color pixel_color)
-{
-	// Write the translated [0,255] value of each color component.
-	out << static_cast<int>(255.999 * pixel_color.x()) << ' '
-		<< static_cast<int>(255.999 * pixel_color.y()) << ' '
-		<< static_cast<int>(255.999 * pixel_color.z()) << '\n';
-}
-void write_color(std::ostream& out, color pixel_color, int samples_per_pixel)
-{
-	auto r = pixel_color.x();
-	auto g = pixel_color.y();
-	auto b = pixel_color.z();
-
-	// With gamma correction for gamma = 2.0
-	auto scale = 1.0 / samples_per_pixel;
-	r = sqrt(scale * r);
-	g = sqrt(scale * g);
-	b = sqrt(scale * b);
-
-	// Write the translated [0,255] value of each color component.
-	std::string output =  
-		std::to_string(static_cast<int>(255.999 * clamp(r, 0.0, 0.999))) + ' ' +
-		std::to_string(static_cast<int>(255.999 * clamp(g, 0.0, 0.999))) + ' ' +
-		std::to_string(static_cast<int>(255.999 * clamp(b, 0.0, 0.999))) + '\n';
-	out << output;
-}
-
-std::string get_color_string(color pixel_color, int samples_per_pixel)
-{
-	auto r = pixel_color.x();
-	auto g = pixel_color.y();
-	auto b = pixel_color.z();
-	// With gamma correction for gamma = 2.0
-	auto scale = 1.0 / samples_per_pixel;
-	r = sqrt(scale * r);
-	g = sqrt(scale * g);
-	b = sqrt(scale * b);
-	// Write the translated [0,255] value of each color component.
-	std::string output =
-		std::to_string(static_cast<int>(255.999 * clamp(r, 0.0, 0.999))) + ' ' +
-		std::to_string(static_cast<int>(255.999 * clamp(g, 0.0, 0.999))) + ' ' +
-		std::to_string(static_cast<int>(255.999 * clamp(b, 0.0, 0.999)));
-	return output;
-}
\ No newline at end of file
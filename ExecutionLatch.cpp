@@ -0,0 +1,48 @@
+#include "ExecutionLatch.h"
+
+ExecutionLatch::ExecutionLatch(int total) : total(total)
+{
+}
+
+void ExecutionLatch::Reset(int total)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	this->total = total;
+	this->completed = 0;
+}
+
+void ExecutionLatch::OnFinishedExecution()
+{
+	// Counted under the lock so a waiter cannot return, and destroy the
+	// latch, before this call is done with it.
+	std::lock_guard<std::mutex> lock(mtx);
+	if (++completed >= total) finished.notify_all();
+}
+
+bool ExecutionLatch::Wait(std::chrono::milliseconds timeout, std::chrono::milliseconds progressInterval, const ProgressCallback& onProgress)
+{
+	using clock = std::chrono::steady_clock;
+	const bool hasTimeout = timeout > std::chrono::milliseconds::zero();
+	const bool hasProgress = onProgress && progressInterval > std::chrono::milliseconds::zero();
+	const auto deadline = clock::now() + timeout;
+
+	std::unique_lock<std::mutex> lock(mtx);
+	while (!IsFinished()) {
+		if (!hasTimeout && !hasProgress) {
+			finished.wait(lock, [this] { return IsFinished(); });
+			break;
+		}
+
+		auto wakeUp = hasProgress ? clock::now() + progressInterval : deadline;
+		if (hasTimeout && deadline < wakeUp) wakeUp = deadline;
+		if (finished.wait_until(lock, wakeUp, [this] { return IsFinished(); })) break;
+		if (hasTimeout && clock::now() >= deadline) return false;
+
+		if (hasProgress) {
+			lock.unlock();
+			onProgress(GetCompleted(), total);
+			lock.lock();
+		}
+	}
+	return true;
+}
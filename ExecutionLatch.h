@@ -0,0 +1,43 @@
+#pragma once
+
+#include "IExecutionEvent.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+
+// Counts finished executions against an expected total and lets another
+// thread block until all of them are done, with an optional timeout and a
+// progress callback invoked from the waiting thread.
+class ExecutionLatch : public IExecutionEvent
+{
+public:
+	using ProgressCallback = std::function<void(int completed, int total)>;
+
+	ExecutionLatch(int total = 0);
+
+	// Not safe to call while executions are still being counted.
+	void Reset(int total);
+	void OnFinishedExecution() override;
+
+	int GetCompleted() const { return completed.load(); }
+	int GetTotal() const { return total; }
+	bool IsFinished() const { return completed.load() >= total; }
+
+	// Blocks until every execution has finished. A zero timeout waits forever.
+	// onProgress, if set, is called every progressInterval while waiting.
+	// Returns false if the timeout expired first.
+	bool Wait(
+		std::chrono::milliseconds timeout = std::chrono::milliseconds::zero(),
+		std::chrono::milliseconds progressInterval = std::chrono::milliseconds::zero(),
+		const ProgressCallback& onProgress = nullptr);
+
+private:
+	std::atomic<int> completed{ 0 };
+	int total = 0;
+
+	std::mutex mtx;
+	std::condition_variable finished;
+};
@@ -0,0 +1,183 @@
+#include "HDRImage.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RT_TONEMAP_SSE2
+#include <immintrin.h>
+#endif
+
+namespace {
+	const size_t cacheLineBytes = 64;
+	const size_t floatsPerLine = cacheLineBytes / sizeof(float);
+
+	// Both formats are little-endian on disk, whatever the host is.
+	void appendLittleEndian(std::vector<unsigned char>& out, uint32_t value) {
+		out.push_back(static_cast<unsigned char>(value));
+		out.push_back(static_cast<unsigned char>(value >> 8));
+		out.push_back(static_cast<unsigned char>(value >> 16));
+		out.push_back(static_cast<unsigned char>(value >> 24));
+	}
+
+	void appendLittleEndian(std::vector<unsigned char>& out, uint64_t value) {
+		appendLittleEndian(out, static_cast<uint32_t>(value));
+		appendLittleEndian(out, static_cast<uint32_t>(value >> 32));
+	}
+
+	void appendFloat(std::vector<unsigned char>& out, float value) {
+		uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		appendLittleEndian(out, bits);
+	}
+
+	void appendString(std::vector<unsigned char>& out, const char* text) {
+		out.insert(out.end(), text, text + std::strlen(text) + 1);
+	}
+
+	// An EXR header attribute: name, type name, value size and value.
+	void appendAttribute(std::vector<unsigned char>& out, const char* name, const char* type, const std::vector<unsigned char>& value) {
+		appendString(out, name);
+		appendString(out, type);
+		appendLittleEndian(out, static_cast<uint32_t>(value.size()));
+		out.insert(out.end(), value.begin(), value.end());
+	}
+
+	bool writeFile(const std::string& fileName, const std::vector<unsigned char>& data) {
+		std::ofstream file(fileName, std::ios::binary);
+		if (!file) return false;
+		file.write(reinterpret_cast<const char*>(data.data()), data.size());
+		return static_cast<bool>(file);
+	}
+}
+
+HDRFramebuffer::HDRFramebuffer(int width, int height, int tileWidth, int tileHeight) :
+	width(width), height(height),
+	tileWidth(std::max(1, std::min(tileWidth, width))), tileHeight(std::max(1, std::min(tileHeight, height)))
+{
+	tilesPerRow = (width + this->tileWidth - 1) / this->tileWidth;
+	const int tileRows = (height + this->tileHeight - 1) / this->tileHeight;
+	const size_t tileFloats = 3 * static_cast<size_t>(this->tileWidth) * this->tileHeight;
+	tileStride = (tileFloats + floatsPerLine - 1) / floatsPerLine * floatsPerLine;
+
+	// One spare line so the first tile can start on a boundary.
+	storage.assign(tileStride * tilesPerRow * tileRows + floatsPerLine, 0.0f);
+	const uintptr_t address = reinterpret_cast<uintptr_t>(storage.data());
+	baseOffset = (cacheLineBytes - address % cacheLineBytes) % cacheLineBytes / sizeof(float);
+}
+
+std::vector<float> HDRFramebuffer::Resolve() const
+{
+	std::vector<float> rgb(3 * static_cast<size_t>(width) * height);
+	for (int y = 0; y < height; ++y) {
+		float* row = &rgb[3 * static_cast<size_t>(height - 1 - y) * width];
+		// Runs of a row within one tile are contiguous.
+		for (int x = 0; x < width; x += tileWidth) {
+			const int run = std::min(tileWidth, width - x);
+			std::memcpy(row + 3 * x, Pixel(x, y), 3 * run * sizeof(float));
+		}
+	}
+	return rgb;
+}
+
+std::vector<unsigned char> ToneMap(const std::vector<float>& linear, const ToneMapping& mapping)
+{
+	const float scale = std::exp2(mapping.exposure);
+	std::vector<unsigned char> out(linear.size());
+	size_t i = 0;
+#ifdef RT_TONEMAP_SSE2
+	// Sixteen values at a time, packed down to sixteen bytes. Lanes round
+	// exactly like the scalar tail, so the output does not depend on which
+	// path a value takes.
+	const __m128 lanesScale = _mm_set1_ps(scale);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 ceiling = _mm_set1_ps(0.999f);
+	const __m128 levels = _mm_set1_ps(255.999f);
+	auto quantize = [&](const float* values) {
+		__m128 v = _mm_sqrt_ps(_mm_max_ps(_mm_mul_ps(lanesScale, _mm_loadu_ps(values)), zero));
+		return _mm_cvttps_epi32(_mm_mul_ps(levels, _mm_min_ps(v, ceiling)));
+	};
+	for (; i + 16 <= linear.size(); i += 16) {
+		const float* values = linear.data() + i;
+		// Every level is in [0,255], so neither pack saturates.
+		__m128i low = _mm_packs_epi32(quantize(values), quantize(values + 4));
+		__m128i high = _mm_packs_epi32(quantize(values + 8), quantize(values + 12));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out.data() + i), _mm_packus_epi16(low, high));
+	}
+#endif
+	for (; i < linear.size(); ++i) {
+		const float v = std::sqrt(std::max(scale * linear[i], 0.0f));
+		out[i] = static_cast<unsigned char>(static_cast<int>(255.999f * std::min(v, 0.999f)));
+	}
+	return out;
+}
+
+bool SavePFM(const std::string& fileName, int width, int height, const std::vector<float>& rgbTopFirst)
+{
+	// A negative scale marks the data little-endian.
+	const std::string header = "PF\n" + std::to_string(width) + " " + std::to_string(height) + "\n-1.0\n";
+	std::vector<unsigned char> data(header.begin(), header.end());
+	data.reserve(data.size() + rgbTopFirst.size() * sizeof(float));
+	for (int y = height - 1; y >= 0; --y) {
+		const float* row = &rgbTopFirst[3 * static_cast<size_t>(y) * width];
+		for (size_t i = 0; i < 3 * static_cast<size_t>(width); ++i) appendFloat(data, row[i]);
+	}
+	return writeFile(fileName, data);
+}
+
+bool SaveEXR(const std::string& fileName, int width, int height, const std::vector<float>& rgbTopFirst)
+{
+	std::vector<unsigned char> data;
+	appendLittleEndian(data, static_cast<uint32_t>(20000630)); // magic number
+	appendLittleEndian(data, static_cast<uint32_t>(2)); // version 2, single-part scanline
+
+	// Channels are listed, and stored in each line, in alphabetical order.
+	const char* channelNames[3] = { "B", "G", "R" };
+	const int channelOffsets[3] = { 2, 1, 0 };
+	std::vector<unsigned char> channels;
+	for (const char* name : channelNames) {
+		appendString(channels, name);
+		appendLittleEndian(channels, static_cast<uint32_t>(2)); // FLOAT
+		channels.insert(channels.end(), { 0, 0, 0, 0 }); // pLinear and reserved
+		appendLittleEndian(channels, static_cast<uint32_t>(1)); // x sampling
+		appendLittleEndian(channels, static_cast<uint32_t>(1)); // y sampling
+	}
+	channels.push_back(0);
+	appendAttribute(data, "channels", "chlist", channels);
+	appendAttribute(data, "compression", "compression", { 0 }); // none
+
+	std::vector<unsigned char> window;
+	for (uint32_t value : { 0u, 0u, static_cast<uint32_t>(width - 1), static_cast<uint32_t>(height - 1) })
+		appendLittleEndian(window, value);
+	appendAttribute(data, "dataWindow", "box2i", window);
+	appendAttribute(data, "displayWindow", "box2i", window);
+	appendAttribute(data, "lineOrder", "lineOrder", { 0 }); // increasing y
+	std::vector<unsigned char> one;
+	appendFloat(one, 1.0f);
+	appendAttribute(data, "pixelAspectRatio", "float", one);
+	std::vector<unsigned char> center;
+	appendFloat(center, 0.0f);
+	appendFloat(center, 0.0f);
+	appendAttribute(data, "screenWindowCenter", "v2f", center);
+	appendAttribute(data, "screenWindowWidth", "float", one);
+	data.push_back(0); // end of header
+
+	// Offset table, then one uncompressed line per block: y, byte count and
+	// each channel's values for the line.
+	const uint32_t lineBytes = 3 * static_cast<uint32_t>(width) * sizeof(float);
+	const uint64_t firstLine = data.size() + sizeof(uint64_t) * static_cast<uint64_t>(height);
+	for (int y = 0; y < height; ++y)
+		appendLittleEndian(data, firstLine + static_cast<uint64_t>(y) * (8 + lineBytes));
+	data.reserve(data.size() + static_cast<size_t>(height) * (8 + lineBytes));
+	for (int y = 0; y < height; ++y) {
+		appendLittleEndian(data, static_cast<uint32_t>(y));
+		appendLittleEndian(data, lineBytes);
+		const float* row = &rgbTopFirst[3 * static_cast<size_t>(y) * width];
+		for (int c : channelOffsets)
+			for (int x = 0; x < width; ++x) appendFloat(data, row[3 * x + c]);
+	}
+	return writeFile(fileName, data);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Display transform applied once, at export, to the linear framebuffer.
+struct ToneMapping {
+	// Stops of exposure; each one doubles the radiance before gamma.
+	float exposure = 0.0f;
+};
+
+// Linear float32 RGB radiance of a whole image, written pixel by pixel as
+// tiles render and read once at export. Pixels are stored tile by tile
+// rather than row by row, and every tile starts on a cache line of its own,
+// so workers filling neighbouring tiles never write the same line. Tiles the
+// scheduler splits further still share lines where the pieces meet. Indexed
+// like the renderer, y up.
+class HDRFramebuffer
+{
+public:
+	HDRFramebuffer() {}
+	HDRFramebuffer(int width, int height, int tileWidth, int tileHeight);
+
+	void SetPixel(int x, int y, float r, float g, float b) {
+		float* rgb = Pixel(x, y);
+		rgb[0] = r;
+		rgb[1] = g;
+		rgb[2] = b;
+	}
+
+	// Linear RGB triples, top row first, as image files store them.
+	std::vector<float> Resolve() const;
+
+	int Width() const { return width; }
+	int Height() const { return height; }
+
+private:
+	float* Pixel(int x, int y) {
+		const int tx = x / tileWidth;
+		const int ty = y / tileHeight;
+		return storage.data() + baseOffset + (static_cast<size_t>(ty) * tilesPerRow + tx) * tileStride
+			+ 3 * (static_cast<size_t>(y - ty * tileHeight) * tileWidth + (x - tx * tileWidth));
+	}
+	const float* Pixel(int x, int y) const { return const_cast<HDRFramebuffer*>(this)->Pixel(x, y); }
+
+	int width = 0;
+	int height = 0;
+	int tileWidth = 1;
+	int tileHeight = 1;
+	int tilesPerRow = 0;
+	// Floats from one tile to the next, a whole number of cache lines.
+	size_t tileStride = 0;
+	std::vector<float> storage;
+	// Index of the first float in storage on a cache line boundary.
+	size_t baseOffset = 0;
+};
+
+// Exposure, gamma 2 and quantization to 8 bits in one pass over linear
+// values, three per pixel: the book's gamma 2 curve, in float.
+std::vector<unsigned char> ToneMap(const std::vector<float>& linear, const ToneMapping& mapping);
+
+// Portable float map: little-endian float32 RGB, bottom row first.
+bool SavePFM(const std::string& fileName, int width, int height, const std::vector<float>& rgbTopFirst);
+// Uncompressed scanline OpenEXR with float32 R, G and B channels.
+bool SaveEXR(const std::string& fileName, int width, int height, const std::vector<float>& rgbTopFirst);
@@ -1,18 +1,23 @@
 #include "IThread.h"
 
-#include <thread>
-
 IThread::IThread()
 {
 }
 
 IThread::~IThread()
 {
+	// Threads that were never joined keep the old fire-and-forget behaviour.
+	if (thread.joinable()) thread.detach();
 }
 
 void IThread::start()
 {
-	std::thread(&IThread::run, this).detach();
+	thread = std::thread(&IThread::run, this);
+}
+
+void IThread::join()
+{
+	if (thread.joinable()) thread.join();
 }
 
 void IThread::sleep(int ms)
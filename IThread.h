@@ -1,14 +1,20 @@
 #pragma once
+
+#include <thread>
+
 class IThread
 {
 public:
 	IThread();
-	~IThread();
+	virtual ~IThread();
 
 	void start();
+	void join();
 	static void sleep(int ms);
 
 protected:
 	virtual void run() = 0;
-};
 
+private:
+	std::thread thread;
+};
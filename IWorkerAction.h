@@ -2,6 +2,7 @@
 class IWorkerAction
 {
 public:
+	virtual ~IWorkerAction() = default;
 	virtual void OnStartTask() = 0;
 };
 
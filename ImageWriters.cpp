@@ -0,0 +1,642 @@
+#include "ImageWriters.h"
+
+#include "TileProtocol.h"
+
+#include <cctype>
+#include <cmath>
+#include <iomanip>
+#include <numeric>
+#include <sstream>
+
+namespace {
+	// Position of (x, y) along a Hilbert curve over an n x n grid, n a power of two.
+	long long HilbertIndex(int n, int x, int y) {
+		long long d = 0;
+		for (int s = n / 2; s > 0; s /= 2) {
+			int rx = (x & s) > 0 ? 1 : 0;
+			int ry = (y & s) > 0 ? 1 : 0;
+			d += static_cast<long long>(s) * s * ((3 * rx) ^ ry);
+			// Rotate the quadrant so the curve stays continuous.
+			if (ry == 0) {
+				if (rx == 1) {
+					x = s - 1 - x;
+					y = s - 1 - y;
+				}
+				std::swap(x, y);
+			}
+		}
+		return d;
+	}
+}
+
+bool ThreadedImageWriter::RenderFixed()
+{
+	if (!PrepareTiles()) return false;
+
+	// A resumed render only has the tiles its checkpoint lacks left to do.
+	std::vector<int> left;
+	for (int t = 0; t < static_cast<int>(tiles.size()); ++t)
+		if (!tileFinished[t].load(std::memory_order_relaxed)) left.push_back(t);
+	ScheduleTiles(left, TileWork::Render);
+	return WaitForTiles();
+}
+
+bool ThreadedImageWriter::RenderDistributed()
+{
+	if (!PrepareTiles()) return false;
+
+	// Every tile carries its whole sample range, so each pixel's sum is
+	// accumulated in the same order as a local render and the images match.
+	std::vector<TileRequest> requests;
+	for (size_t t = 0; t < tiles.size(); ++t) {
+		if (tileFinished[t].load(std::memory_order_relaxed)) continue;
+		requests.emplace_back();
+		TileRequest& request = requests.back();
+		request.id = static_cast<uint32_t>(t);
+		request.x = tiles[t].x;
+		request.y = tiles[t].y;
+		request.width = tiles[t].width;
+		request.height = tiles[t].height;
+		request.firstSample = 0;
+		request.lastSample = samples_per_pixel;
+	}
+
+	currentWork = TileWork::Render;
+	completion.Reset(static_cast<int>(requests.size()));
+	auto onResult = [this](const TileResultHeader& result, const real* sums) {
+		const TileRequest& request = result.tile;
+		for (int y = request.y; y < request.y + request.height; ++y) {
+			for (int x = request.x; x < request.x + request.width; ++x, sums += 3) {
+				const color sum(sums[0], sums[1], sums[2]);
+				if (checkpointWriter) {
+					accumulation.at(x, y).sum = sum;
+					accumulation.at(x, y).samples = samples_per_pixel;
+				}
+				StorePixel(x, y, sum);
+			}
+		}
+		tiles[request.id].samples = samples_per_pixel;
+		tiles[request.id].seconds = result.seconds;
+		tileFinished[request.id].store(true, std::memory_order_release);
+		progress.samples.fetch_add(static_cast<long long>(request.width) * request.height * samples_per_pixel, std::memory_order_relaxed);
+		completion.OnFinishedExecution();
+	};
+
+	const bool reporting = verbose || onProgress;
+	bool timedOut = false;
+	auto lastReport = Clock::now();
+	auto tick = [&]() {
+		auto now = Clock::now();
+		if (timeout != std::chrono::milliseconds::zero() && now - runStart >= timeout) {
+			timedOut = true;
+			return false;
+		}
+		if (reporting && now - lastReport >= progressInterval) {
+			ReportProgress();
+			lastReport = now;
+		}
+		SaveCheckpointIfDue();
+		return true;
+	};
+
+	std::vector<int> left = coordinator->Render(requests, onResult, tick);
+	for (int& index : left) index = static_cast<int>(requests[index].id);
+	if (timedOut) {
+		Cancel();
+		if (verbose) std::cerr << "\nTimed out.\n";
+		SaveCheckpointNow();
+		return false;
+	}
+	if (reporting) ReportProgress();
+	if (left.empty()) return true;
+
+	if (verbose) std::cerr << "\nNo workers left, rendering the last " << left.size() << " tiles locally.\n";
+	ScheduleTiles(left, TileWork::Render);
+	return WaitForTiles();
+}
+
+bool ThreadedImageWriter::RenderProgressive()
+{
+	if (!PrepareTiles()) return false;
+
+	for (int pass = completedPasses + 1; ; ++pass) {
+		currentPass = pass;
+		std::vector<int> active;
+		for (int t = 0; t < static_cast<int>(tiles.size()); ++t)
+			if (tiles[t].active) active.push_back(t);
+		if (active.empty()) break;
+
+		ScheduleTiles(active, TileWork::Pass);
+		if (!WaitForTiles()) return false;
+
+		// Tiles are idle between passes, so this is when checkpoints are taken.
+		completedPasses = pass;
+		SaveCheckpointIfDue();
+
+		double elapsed = resumedSeconds + SecondsSince(runStart);
+		if (verbose) std::cerr << "\nPass " << pass << ": refined " << active.size() << " of " << tiles.size()
+			<< " tiles, " << elapsed << " s" << std::endl;
+
+		if (progressive.snapshotInterval > 0 && pass % progressive.snapshotInterval == 0) {
+			// A failed snapshot is reported but does not stop the render; the
+			// final export decides whether Run() succeeds.
+			ResolveFilm();
+			Export();
+		}
+		if (progressive.timeBudget > 0.0 && elapsed >= progressive.timeBudget) break;
+	}
+
+	if (verbose)
+		std::cerr << "Average samples per pixel: " << static_cast<double>(GetSampleCount()) / (image_width * image_height) << "\n";
+
+	ResolveFilm();
+	return true;
+}
+
+void TileAction::OnStartTask()
+{
+	if (writer == nullptr) return;
+	if (!writer->IsCancelled()) writer->ExecuteTile(tileIndex, work, slot);
+	writer->OnFinishedExecution();
+}
+
+void ThreadedImageWriter::ScheduleTiles(const std::vector<int>& indices, TileWork work)
+{
+	// Tiles are dealt round-robin and every worker pops its own deque newest
+	// first, so scheduling in reverse starts them in list order. Thieves take
+	// from the other end, which then holds the cheapest tiles.
+	// Every earlier task has reported back through the latch by now, so
+	// their slots can be reused.
+	tileTasks.Reset();
+	currentWork = work;
+	batchCounters.assign(indices.size(), render_counters());
+	spanBase = spans.size();
+	if (traceEnabled) spans.resize(spanBase + indices.size());
+	completion.Reset(static_cast<int>(indices.size()));
+	for (int slot = static_cast<int>(indices.size()) - 1; slot >= 0; --slot)
+		threadPool.ScheduleTask(tileTasks.Create(this, indices[slot], work, slot));
+}
+
+void ThreadedImageWriter::ExecuteTile(int tileIndex, TileWork work, int slot)
+{
+	const render_counters before = thread_counters;
+	const Tile& tile = tiles[tileIndex];
+	const int samplesBefore = tile.samples;
+	TileSpan span;
+	if (traceEnabled) {
+		span.x = tile.x;
+		span.y = tile.y;
+		span.width = tile.width;
+		span.height = tile.height;
+		span.work = work;
+		span.thread = render_thread_index();
+		span.start = SecondsSince(runStart);
+	}
+
+	switch (work) {
+	case TileWork::Probe: ProbeTile(tileIndex); break;
+	case TileWork::Render: RenderTile(tileIndex); break;
+	case TileWork::Pass: RenderTilePass(tileIndex); break;
+	}
+
+	render_counters& counted = batchCounters[slot];
+	counted = thread_counters - before;
+
+	// Probes are thrown away, so only their rays count as progress.
+	const long long pixels = static_cast<long long>(tile.width) * tile.height;
+	if (work == TileWork::Render) progress.samples.fetch_add(pixels * samples_per_pixel, std::memory_order_relaxed);
+	else if (work == TileWork::Pass) progress.samples.fetch_add(pixels * (tile.samples - samplesBefore), std::memory_order_relaxed);
+	progress.rays.fetch_add(counted.rays(), std::memory_order_relaxed);
+	if (traceEnabled) {
+		span.end = SecondsSince(runStart);
+		span.rays = counted.rays();
+		span.nodeVisits = counted.node_visits;
+		span.primitiveTests = counted.sphere_tests + counted.triangle_tests;
+		spans[spanBase + slot] = span;
+	}
+}
+
+bool ThreadedImageWriter::PrepareTiles()
+{
+	if (progressiveEnabled || checkpointWriter) accumulation = film(image_width, image_height, block_width, block_height);
+	if (resumeState) {
+		RestoreCheckpoint();
+		return true;
+	}
+
+	CreateBlockScans(block_width, block_height);
+	estimateSeconds = 0.0;
+
+	bool haveCosts = false;
+	if (schedule.costSource == TileCostSource::PrePass) {
+		auto start = Clock::now();
+		if (!EstimateTileCosts()) return false;
+		estimateSeconds = SecondsSince(start);
+		haveCosts = true;
+	}
+	else if (schedule.costSource == TileCostSource::LastRun && lastRunCosts.size() == tiles.size()) {
+		for (size_t t = 0; t < tiles.size(); ++t)
+			tiles[t].cost = lastRunCosts[t];
+		haveCosts = true;
+	}
+
+	if (haveCosts) SubdivideTiles();
+	OrderTiles();
+	tileFinished = std::vector<std::atomic<bool>>(tiles.size());
+	return true;
+}
+
+void ThreadedImageWriter::SetCheckpoint(const std::string& path, std::chrono::milliseconds interval, uint64_t fingerprint)
+{
+	checkpointWriter = std::make_unique<CheckpointWriter>(path);
+	checkpointInterval = interval;
+	checkpointFingerprint = fingerprint;
+}
+
+bool ThreadedImageWriter::ResumeFrom(const std::string& path, uint64_t fingerprint, std::string& error)
+{
+	auto saved = std::make_unique<RenderCheckpoint>();
+	if (!LoadCheckpoint(path, *saved, error)) return false;
+	if (saved->fingerprint != fingerprint || saved->width != image_width || saved->height != image_height
+		|| saved->progressive != progressiveEnabled) {
+		error = path + " was saved by a render with other options";
+		return false;
+	}
+	resumeState = std::move(saved);
+	return true;
+}
+
+void ThreadedImageWriter::RestoreCheckpoint()
+{
+	const RenderCheckpoint& saved = *resumeState;
+	tiles.clear();
+	tileFinished = std::vector<std::atomic<bool>>(saved.tiles.size());
+	size_t pixel = 0;
+	for (size_t t = 0; t < saved.tiles.size(); ++t) {
+		const RenderCheckpoint::Tile& savedTile = saved.tiles[t];
+		Tile tile;
+		tile.x = savedTile.x;
+		tile.y = savedTile.y;
+		tile.width = savedTile.width;
+		tile.height = savedTile.height;
+		tile.parent = savedTile.parent;
+		tile.samples = savedTile.samples;
+		tile.active = savedTile.active != 0;
+		tile.seconds = savedTile.seconds;
+		tiles.push_back(tile);
+		if (progressiveEnabled || !savedTile.finished) continue;
+
+		// Finished tiles of a fixed render go straight to the image.
+		for (int y = tile.y; y < tile.y + tile.height; ++y) {
+			for (int x = tile.x; x < tile.x + tile.width; ++x, ++pixel) {
+				if (checkpointWriter) {
+					accumulation.at(x, y).sum = saved.pixels[pixel].sum;
+					accumulation.at(x, y).samples = samples_per_pixel;
+				}
+				StorePixel(x, y, saved.pixels[pixel].sum);
+			}
+		}
+		tileFinished[t].store(true, std::memory_order_relaxed);
+		resumedSamples += static_cast<long long>(tile.width) * tile.height * samples_per_pixel;
+	}
+	if (progressiveEnabled) {
+		accumulation.set_row_major(saved.pixels);
+		for (const pixel_estimate& estimate : saved.pixels) resumedSamples += estimate.samples;
+	}
+	completedPasses = saved.passes;
+	resumedSeconds = saved.elapsedSeconds;
+	progress.samples = resumedSamples;
+	if (verbose) std::cerr << "Resuming after " << resumedSeconds << " s, " << resumedSamples << " samples.\n";
+	resumeState.reset();
+}
+
+RenderCheckpoint ThreadedImageWriter::CaptureCheckpoint() const
+{
+	RenderCheckpoint saved;
+	saved.fingerprint = checkpointFingerprint;
+	saved.width = image_width;
+	saved.height = image_height;
+	saved.progressive = progressiveEnabled;
+	saved.passes = completedPasses;
+	saved.elapsedSeconds = resumedSeconds + SecondsSince(runStart);
+	saved.tiles.reserve(tiles.size());
+	for (size_t t = 0; t < tiles.size(); ++t) {
+		const Tile& tile = tiles[t];
+		RenderCheckpoint::Tile savedTile;
+		savedTile.x = tile.x;
+		savedTile.y = tile.y;
+		savedTile.width = tile.width;
+		savedTile.height = tile.height;
+		savedTile.parent = tile.parent;
+		if (progressiveEnabled) {
+			savedTile.samples = tile.samples;
+			savedTile.active = tile.active ? 1 : 0;
+			savedTile.seconds = tile.seconds;
+		}
+		else if (tileFinished[t].load(std::memory_order_acquire)) {
+			// The worker is done with the tile, so its fields and pixels are final.
+			savedTile.samples = tile.samples;
+			savedTile.finished = 1;
+			savedTile.seconds = tile.seconds;
+			for (int y = tile.y; y < tile.y + tile.height; ++y)
+				for (int x = tile.x; x < tile.x + tile.width; ++x)
+					saved.pixels.push_back(accumulation.at(x, y));
+		}
+		saved.tiles.push_back(savedTile);
+	}
+	if (progressiveEnabled) saved.pixels = accumulation.row_major();
+	return saved;
+}
+
+void ThreadedImageWriter::SaveCheckpointIfDue()
+{
+	if (!checkpointWriter || Clock::now() - lastCheckpoint < checkpointInterval) return;
+	// Better to skip one than queue copies of the image behind a slow disk.
+	if (checkpointWriter->IsBusy()) return;
+	checkpointWriter->Submit(CaptureCheckpoint());
+	lastCheckpoint = Clock::now();
+}
+
+void ThreadedImageWriter::SaveCheckpointNow()
+{
+	// The tiles are not settled until the cost pre-pass is over.
+	if (!checkpointWriter || currentWork == TileWork::Probe) return;
+	checkpointWriter->Submit(CaptureCheckpoint());
+	checkpointWriter->Flush();
+	lastCheckpoint = Clock::now();
+	if (verbose) std::cerr << "Saved checkpoint " << checkpointWriter->GetPath() << "\n";
+}
+
+bool ThreadedImageWriter::EstimateTileCosts()
+{
+	std::vector<int> all(tiles.size());
+	std::iota(all.begin(), all.end(), 0);
+	ScheduleTiles(all, TileWork::Probe);
+	return WaitForTiles();
+}
+
+void ThreadedImageWriter::SubdivideTiles()
+{
+	double total = 0.0;
+	for (const Tile& tile : tiles) total += tile.cost;
+	double target = total / (static_cast<double>(threadPool.GetWorkerCount()) * schedule.tilesPerThread);
+	if (target <= 0.0) return;
+
+	// Halves along the longer side, splitting the cost by area, until every
+	// piece is under target or too small to split. Pieces stay next to each
+	// other so the order below still sees them in place.
+	std::vector<Tile> split;
+	std::vector<Tile> stack;
+	for (const Tile& tile : tiles) {
+		stack.push_back(tile);
+		while (!stack.empty()) {
+			Tile t = stack.back();
+			stack.pop_back();
+			bool splitX = t.width >= t.height;
+			int size = splitX ? t.width : t.height;
+			if (t.cost <= target || size < 2 * schedule.minTileSize) {
+				split.push_back(t);
+				continue;
+			}
+			Tile a = t;
+			Tile b = t;
+			if (splitX) {
+				a.width = t.width / 2;
+				b.x = t.x + a.width;
+				b.width = t.width - a.width;
+			}
+			else {
+				a.height = t.height / 2;
+				b.y = t.y + a.height;
+				b.height = t.height - a.height;
+			}
+			double area = static_cast<double>(t.width) * t.height;
+			a.cost = t.cost * (static_cast<double>(a.width) * a.height) / area;
+			b.cost = t.cost - a.cost;
+			stack.push_back(b);
+			stack.push_back(a);
+		}
+	}
+	tiles.swap(split);
+}
+
+void ThreadedImageWriter::OrderTiles()
+{
+	auto byKey = [this](auto key) {
+		std::vector<std::pair<double, int>> keyed;
+		keyed.reserve(tiles.size());
+		for (int t = 0; t < static_cast<int>(tiles.size()); ++t)
+			keyed.emplace_back(key(tiles[t]), t);
+		std::stable_sort(keyed.begin(), keyed.end(),
+			[](const auto& a, const auto& b) { return a.first < b.first; });
+		std::vector<Tile> ordered;
+		ordered.reserve(tiles.size());
+		for (const auto& k : keyed) ordered.push_back(tiles[k.second]);
+		tiles.swap(ordered);
+	};
+
+	// Subdivided tiles keep the grid cell of the block they came from.
+	const int cellWidth = std::max(1, block_width);
+	const int cellHeight = std::max(1, block_height);
+	const int columns = (image_width + cellWidth - 1) / cellWidth;
+	const int rows = (image_height + cellHeight - 1) / cellHeight;
+
+	switch (schedule.order) {
+	case TileOrder::Rows:
+		break;
+	case TileOrder::Hilbert: {
+		int n = 1;
+		while (n < columns || n < rows) n *= 2;
+		byKey([&](const Tile& tile) {
+			return static_cast<double>(HilbertIndex(n, tile.x / cellWidth, tile.y / cellHeight));
+		});
+		break;
+	}
+	case TileOrder::Spiral: {
+		// Rings of cells around the center, each ring walked by angle.
+		const double cx = 0.5 * (columns - 1);
+		const double cy = 0.5 * (rows - 1);
+		byKey([&](const Tile& tile) {
+			double dx = tile.x / cellWidth - cx;
+			double dy = tile.y / cellHeight - cy;
+			double ring = std::floor(std::max(std::fabs(dx), std::fabs(dy)));
+			return ring * 8.0 + std::atan2(dy, dx) + pi;
+		});
+		break;
+	}
+	case TileOrder::CostDescending:
+		byKey([](const Tile& tile) { return -tile.cost; });
+		break;
+	}
+}
+
+RenderProgress ThreadedImageWriter::GetProgress() const
+{
+	RenderProgress p;
+	p.work = currentWork;
+	p.pass = currentPass;
+	p.tilesDone = completion.GetCompleted();
+	p.tilesTotal = completion.GetTotal();
+	p.samplesDone = progress.samples.load(std::memory_order_relaxed);
+	p.samplesTotal = progressiveEnabled ? 0 : static_cast<long long>(image_width) * image_height * samples_per_pixel;
+	p.rays = progress.rays.load(std::memory_order_relaxed);
+	p.elapsedSeconds = SecondsSince(runStart);
+	// Rates are this run's; samples restored from a checkpoint only count as done.
+	if (p.elapsedSeconds > 0.0) {
+		p.samplesPerSecond = (p.samplesDone - resumedSamples) / p.elapsedSeconds;
+		p.raysPerSecond = p.rays / p.elapsedSeconds;
+	}
+	// Extrapolates the sample rate so far; progressive renders only know
+	// when their time budget runs out.
+	if (p.samplesTotal > 0 && p.samplesPerSecond > 0.0)
+		p.etaSeconds = (p.samplesTotal - p.samplesDone) / p.samplesPerSecond;
+	else if (progressiveEnabled && progressive.timeBudget > 0.0)
+		p.etaSeconds = std::max(0.0, progressive.timeBudget - resumedSeconds - p.elapsedSeconds);
+	return p;
+}
+
+void ThreadedImageWriter::ReportProgress() const
+{
+	RenderProgress p = GetProgress();
+	if (onProgress) onProgress(p);
+	if (!verbose) return;
+
+	std::ostringstream line;
+	line << std::fixed << std::setprecision(1);
+	if (p.work == TileWork::Probe) line << "Estimating tile costs";
+	else if (progressiveEnabled) line << "Pass " << p.pass;
+	else line << "Rendering";
+	line << ": tiles " << p.tilesDone << "/" << p.tilesTotal;
+	if (p.samplesTotal > 0 && p.work != TileWork::Probe) line << ", " << 100.0 * p.samplesDone / p.samplesTotal << "%";
+	if (p.rays > 0) line << ", " << p.raysPerSecond / 1e6 << " Mrays/s";
+	else line << ", " << p.samplesPerSecond / 1e6 << " Msamples/s";
+	if (p.etaSeconds >= 0.0) line << ", ETA " << p.etaSeconds << " s";
+	// Padded so a shorter line fully covers the last one.
+	std::string text = line.str();
+	if (text.size() < 72) text.resize(72, ' ');
+	std::cerr << "\r" << text << std::flush;
+}
+
+void ThreadedImageWriter::RememberTileCosts()
+{
+	int baseTiles = 0;
+	for (const Tile& tile : tiles) baseTiles = std::max(baseTiles, tile.parent + 1);
+	lastRunCosts.assign(baseTiles, 0.0);
+	for (const Tile& tile : tiles) lastRunCosts[tile.parent] += tile.seconds;
+}
+
+TileStatistics ThreadedImageWriter::GetTileStatistics() const
+{
+	TileStatistics stats;
+	stats.tiles = static_cast<int>(tiles.size());
+	stats.estimateSeconds = estimateSeconds;
+	if (tiles.empty()) return stats;
+
+	std::vector<double> seconds;
+	seconds.reserve(tiles.size());
+	for (const Tile& tile : tiles) seconds.push_back(tile.seconds);
+	std::sort(seconds.begin(), seconds.end());
+
+	stats.minSeconds = seconds.front();
+	stats.maxSeconds = seconds.back();
+	stats.p95Seconds = seconds[static_cast<size_t>(0.95 * (seconds.size() - 1))];
+	stats.totalSeconds = std::accumulate(seconds.begin(), seconds.end(), 0.0);
+	stats.meanSeconds = stats.totalSeconds / seconds.size();
+	// Distributed tiles ran on the workers, not on the thread pool.
+	if (coordinator) stats.utilization = -1.0;
+	// Restored tiles keep the seconds of the runs before, so those count too.
+	else if (renderSeconds > 0.0)
+		stats.utilization = stats.totalSeconds / ((resumedSeconds + renderSeconds) * threadPool.GetWorkerCount());
+	return stats;
+}
+
+void ThreadedImageWriter::PrintTileStatistics() const
+{
+	TileStatistics stats = GetTileStatistics();
+	std::cerr << "\nTiles: " << stats.tiles << ", seconds min " << stats.minSeconds << " mean " << stats.meanSeconds
+		<< " p95 " << stats.p95Seconds << " max " << stats.maxSeconds;
+	if (stats.utilization >= 0.0) std::cerr << ", utilization " << 100.0 * stats.utilization << "%";
+	if (stats.estimateSeconds > 0.0) std::cerr << ", cost pre-pass " << stats.estimateSeconds << " s";
+	std::cerr << "\n";
+}
+
+bool HDRThreadedWriter::Export()
+{
+	auto endsWith = [this](const char* suffix) {
+		const std::string ending(suffix);
+		if (filename.size() < ending.size()) return false;
+		return std::equal(ending.rbegin(), ending.rend(), filename.rbegin(),
+			[](char a, char b) { return a == std::tolower(static_cast<unsigned char>(b)); });
+	};
+	const std::vector<float> linear = framebuffer.Resolve();
+	const bool saved = endsWith(".exr")
+		? SaveEXR(filename, image_width, image_height, linear)
+		: SavePFM(filename, image_width, image_height, linear);
+	if (!saved) std::cerr << "Could not write " << filename << "\n";
+	return saved;
+}
+
+void IImageWriter::WriteStats(std::ostream& out) const
+{
+	out << "{\n"
+		<< "  \"width\": " << image_width << ",\n"
+		<< "  \"height\": " << image_height << ",\n"
+		<< "  \"samples\": " << GetSampleCount() << ",\n"
+		<< "  \"render_s\": " << renderSeconds << ",\n"
+		<< "  \"export_s\": " << exportSeconds << ",\n"
+		<< "  \"counters\": ";
+	write_counters_json(out, counters, "  ");
+	WriteStatsDetail(out);
+	out << "\n}\n";
+}
+
+void ThreadedImageWriter::WriteStatsDetail(std::ostream& out) const
+{
+	TileStatistics stats = GetTileStatistics();
+	if (stats.utilization >= 0.0) out << ",\n  \"utilization\": " << stats.utilization;
+	out << ",\n  \"estimate_s\": " << stats.estimateSeconds
+		<< ",\n  \"tiles\": [";
+	for (size_t t = 0; t < tiles.size(); ++t) {
+		const Tile& tile = tiles[t];
+		out << (t ? "," : "") << "\n    { \"x\": " << tile.x << ", \"y\": " << tile.y
+			<< ", \"width\": " << tile.width << ", \"height\": " << tile.height
+			<< ", \"samples\": " << (progressiveEnabled ? tile.samples : samples_per_pixel)
+			<< ", \"seconds\": " << tile.seconds << " }";
+	}
+	out << "\n  ]";
+}
+
+void ThreadedImageWriter::WriteChromeTrace(std::ostream& out) const
+{
+	static const char* const workNames[] = { "probe", "render", "pass" };
+
+	// Complete ("X") events in microseconds, plus a name for every thread row.
+	const std::ios::fmtflags flags = out.flags();
+	const std::streamsize precision = out.precision();
+	out << std::fixed << std::setprecision(1);
+	out << "{ \"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+	bool first = true;
+	std::vector<int> threads;
+	for (const TileSpan& span : spans) {
+		// Tasks cancelled before they ran have no span.
+		if (span.end <= 0.0) continue;
+		if (std::find(threads.begin(), threads.end(), span.thread) == threads.end())
+			threads.push_back(span.thread);
+		out << (first ? "" : ",") << "\n  { \"name\": \"" << workNames[static_cast<int>(span.work)]
+			<< " " << span.x << "," << span.y << "\", \"cat\": \"tile\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << span.thread
+			<< ", \"ts\": " << span.start * 1e6 << ", \"dur\": " << (span.end - span.start) * 1e6
+			<< ", \"args\": { \"x\": " << span.x << ", \"y\": " << span.y
+			<< ", \"width\": " << span.width << ", \"height\": " << span.height
+			<< ", \"rays\": " << span.rays << ", \"node_visits\": " << span.nodeVisits
+			<< ", \"primitive_tests\": " << span.primitiveTests << " } }";
+		first = false;
+	}
+	for (int thread : threads) {
+		out << (first ? "" : ",") << "\n  { \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << thread
+			<< ", \"args\": { \"name\": \"worker " << thread << "\" } }";
+		first = false;
+	}
+	out << "\n] }\n";
+	out.flags(flags);
+	out.precision(precision);
+}
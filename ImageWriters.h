@@ -0,0 +1,992 @@
+#pragma once
+
+#include "rtweekend.h"
+
+#include "hittable.h"
+#include "camera.h"
+#include "integrator.h"
+#include "ray_packet.h"
+#include "wavefront.h"
+#include "IExecutionEvent.h"
+#include "IWorkerAction.h"
+#include "ExecutionLatch.h"
+#include "ThreadPool.h"
+#include "TaskPool.h"
+#include "film.h"
+#include "render_stats.h"
+#include "PNGImage.h"
+#include "HDRImage.h"
+#include "RenderCheckpoint.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+// P6 pixel data is binary, so stdout must not translate newlines on Windows.
+inline void SetStdoutBinary() {
+#ifdef _WIN32
+	_setmode(_fileno(stdout), _O_BINARY);
+#endif
+}
+
+class IImageWriter : public IExecutionEvent {
+public:
+	IImageWriter(camera* cam, hittable* world, int image_width, int image_height, int samples_per_pixel, int max_depth) :
+		cam(cam), world(world), image_width(image_width), image_height(image_height), samples_per_pixel(samples_per_pixel) {
+		integrator.max_depth = max_depth;
+	};
+	virtual ~IImageWriter() = default;
+
+	// Returns false if the render was cancelled or timed out before finishing.
+	virtual bool Run() = 0;
+	virtual void WriteHeader() = 0;
+	// Receives the sum of samples_per_pixel samples for one pixel.
+	virtual void StorePixel(int x, int y, const color& pixel_color) = 0;
+	virtual void WritePixel(int x, int y) {
+		StorePixel(x, y, SamplePixel(x, y));
+	}
+
+	color SamplePixel(int x, int y) const {
+		color pixel_color(0, 0, 0);
+		for (int s = 0; s < samples_per_pixel; ++s)
+			pixel_color += TraceSample(x, y, s);
+		return pixel_color;
+	}
+
+	// Radiance of sample s of a pixel.
+	color TraceSample(int x, int y, int s) const {
+		sampler rng = pixel_sampler(x, y, s);
+		auto u = (x + random_double(rng)) / (image_width - 1);
+		auto v = (y + random_double(rng)) / (image_height - 1);
+		ray r = cam->get_ray(u, v, rng);
+		return ray_color(r, *world, integrator, rng);
+	}
+
+	// Renders a rectangle of pixels. With packets enabled, the primary rays of
+	// each size x size group of pixels are traced together and every path
+	// continues on its own after the first hit. Output matches WritePixel.
+	void WriteBlock(int startX, int startY, int blockWidth, int blockHeight) {
+		if (wavefront_batch > 0) {
+			std::vector<color> sums(static_cast<size_t>(blockWidth) * blockHeight, color(0, 0, 0));
+			TraceBlock(startX, startY, blockWidth, blockHeight, 0, samples_per_pixel,
+				[&](int x, int y, const color& c) { sums[(y - startY) * blockWidth + (x - startX)] += c; });
+			for (int y = startY; y < startY + blockHeight; ++y)
+				for (int x = startX; x < startX + blockWidth; ++x)
+					StorePixel(x, y, sums[(y - startY) * blockWidth + (x - startX)]);
+			return;
+		}
+		if (packet_size <= 1) {
+			for (int y = startY; y < startY + blockHeight; ++y)
+				for (int x = startX; x < startX + blockWidth; ++x)
+					WritePixel(x, y);
+			return;
+		}
+
+		color sums[ray_packet::max_size];
+		for (int py = startY; py < startY + blockHeight; py += packet_size) {
+			for (int px = startX; px < startX + blockWidth; px += packet_size) {
+				int pw = std::min(packet_size, startX + blockWidth - px);
+				int ph = std::min(packet_size, startY + blockHeight - py);
+				for (int i = 0; i < pw * ph; ++i) sums[i] = color(0, 0, 0);
+
+				TraceBlock(px, py, pw, ph, 0, samples_per_pixel,
+					[&](int x, int y, const color& c) { sums[(y - py) * pw + (x - px)] += c; });
+
+				for (int j = 0; j < ph; ++j)
+					for (int i = 0; i < pw; ++i)
+						StorePixel(px + i, py + j, sums[j * pw + i]);
+			}
+		}
+	}
+
+	// Traces samples [firstSample, lastSample) of every pixel in a rectangle
+	// and hands each to addSample(x, y, radiance), in sample order per pixel.
+	template <typename AddSample>
+	void TraceBlock(int startX, int startY, int blockWidth, int blockHeight, int firstSample, int lastSample, AddSample addSample) const {
+		if (wavefront_batch > 0) {
+			TraceBlockWavefront(startX, startY, blockWidth, blockHeight, firstSample, lastSample, addSample);
+			return;
+		}
+		if (packet_size <= 1) {
+			for (int y = startY; y < startY + blockHeight; ++y)
+				for (int x = startX; x < startX + blockWidth; ++x)
+					for (int s = firstSample; s < lastSample; ++s)
+						addSample(x, y, TraceSample(x, y, s));
+			return;
+		}
+
+		ray_packet packet;
+		std::vector<sampler> rngs;
+		rngs.reserve(ray_packet::max_size);
+
+		for (int py = startY; py < startY + blockHeight; py += packet_size) {
+			for (int px = startX; px < startX + blockWidth; px += packet_size) {
+				int pw = std::min(packet_size, startX + blockWidth - px);
+				int ph = std::min(packet_size, startY + blockHeight - py);
+
+				for (int s = firstSample; s < lastSample; ++s) {
+					packet.clear();
+					rngs.clear();
+					for (int j = 0; j < ph; ++j) {
+						for (int i = 0; i < pw; ++i) {
+							rngs.push_back(pixel_sampler(px + i, py + j, s));
+							sampler& rng = rngs.back();
+							auto u = (px + i + random_double(rng)) / (image_width - 1);
+							auto v = (py + j + random_double(rng)) / (image_height - 1);
+							packet.add(cam->get_ray(u, v, rng));
+						}
+					}
+					packet.prepare();
+					if (integrator.max_depth > 0) world->hit_packet(packet, 0.001);
+					for (int i = 0; i < packet.size; ++i)
+						addSample(px + i % pw, py + i / pw, trace_path(packet.rays[i], packet.hit[i], packet.rec[i], *world, integrator, rngs[i]));
+				}
+			}
+		}
+	}
+
+	// TraceBlock for the wavefront integrator. Samples are traced in waves of
+	// about wavefront_batch paths, queued by pixel group, then sample, then
+	// pixel so primary rays stay coherent; with packets enabled each group of
+	// one sample is intersected as a packet.
+	template <typename AddSample>
+	void TraceBlockWavefront(int startX, int startY, int blockWidth, int blockHeight, int firstSample, int lastSample, AddSample addSample) const {
+		// Keeps the queues' storage from one tile to the next.
+		thread_local wavefront_integrator wavefront;
+		const bool packets = packet_size > 1;
+		const int group = packets ? packet_size : 8;
+		const int samplesPerWave = std::max(1, wavefront_batch / (blockWidth * blockHeight));
+
+		for (int s0 = firstSample; s0 < lastSample; s0 += samplesPerWave) {
+			const int s1 = std::min(lastSample, s0 + samplesPerWave);
+			wavefront.clear();
+			for (int py = startY; py < startY + blockHeight; py += group) {
+				for (int px = startX; px < startX + blockWidth; px += group) {
+					int pw = std::min(group, startX + blockWidth - px);
+					int ph = std::min(group, startY + blockHeight - py);
+					for (int s = s0; s < s1; ++s) {
+						wavefront.begin_packet();
+						for (int j = 0; j < ph; ++j) {
+							for (int i = 0; i < pw; ++i) {
+								sampler rng = pixel_sampler(px + i, py + j, s);
+								auto u = (px + i + random_double(rng)) / (image_width - 1);
+								auto v = (py + j + random_double(rng)) / (image_height - 1);
+								ray r = cam->get_ray(u, v, rng);
+								wavefront.add_path(r, rng);
+							}
+						}
+					}
+				}
+			}
+
+			wavefront.trace(*world, integrator, packets);
+
+			// Same walk as above, handing each pixel its samples in order.
+			size_t base = 0;
+			for (int py = startY; py < startY + blockHeight; py += group) {
+				for (int px = startX; px < startX + blockWidth; px += group) {
+					int pw = std::min(group, startX + blockWidth - px);
+					int ph = std::min(group, startY + blockHeight - py);
+					for (int j = 0; j < ph; ++j)
+						for (int i = 0; i < pw; ++i)
+							for (int s = s0; s < s1; ++s)
+								addSample(px + i, py + j, wavefront.result(base + static_cast<size_t>(s - s0) * pw * ph + j * pw + i));
+					base += static_cast<size_t>(s1 - s0) * pw * ph;
+				}
+			}
+		}
+	}
+
+	// Side of the square pixel groups traced as primary ray packets (at most 8).
+	// 0 or 1 traces every ray on its own.
+	void SetPacketSize(int size) { packet_size = std::max(0, std::min(size, 8)); }
+
+	// Russian roulette may end paths after min_bounces; none go past max_depth.
+	void SetBounceLimits(int min_bounces, int max_depth) {
+		integrator.min_bounces = min_bounces;
+		integrator.max_depth = max_depth;
+	}
+	void SetRussianRoulette(bool enabled) { integrator.russian_roulette = enabled; }
+	// Traces tiles breadth-first in waves of about batchSize paths instead of
+	// one path at a time. Zero turns the wavefront integrator off.
+	void SetWavefront(int batchSize) { wavefront_batch = std::max(0, batchSize); }
+
+	// Each sample draws from its own generator, so the image only depends on
+	// the pixel and sample index, not on which thread rendered it.
+	sampler pixel_sampler(int x, int y, int s) const {
+		return sampler(static_cast<uint64_t>(y) * image_width + x, s);
+	}
+
+	// Pending work is skipped once cancelled; Run() then returns false.
+	void Cancel() { cancelled = true; }
+	bool IsCancelled() const { return cancelled.load(); }
+
+	// Turns the progress and status messages on stderr on or off.
+	void SetVerbose(bool enabled) { verbose = enabled; }
+	// How 8-bit outputs turn radiance into pixel values.
+	void SetToneMapping(const ToneMapping& mapping) { toneMapping = mapping; }
+
+	// Phase timings of the last Run(): tracing, then tone mapping and
+	// writing the file.
+	double GetRenderSeconds() const { return renderSeconds; }
+	double GetExportSeconds() const { return exportSeconds; }
+	// Samples traced by the last Run().
+	virtual long long GetSampleCount() const {
+		return static_cast<long long>(image_width) * image_height * samples_per_pixel;
+	}
+	// What the last Run() traced. All zero unless the build defines RT_STATS.
+	const render_counters& GetCounters() const { return counters; }
+	// Writes the timings and counters of the last Run() as JSON.
+	void WriteStats(std::ostream& out) const;
+
+protected:
+	using Clock = std::chrono::steady_clock;
+	static double SecondsSince(Clock::time_point start) {
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	}
+	// Adds writer specific fields to WriteStats, each starting with ",\n".
+	virtual void WriteStatsDetail(std::ostream&) const {}
+
+	// Keeps the mean radiance of a pixel, given the sum StorePixel gets,
+	// in the framebuffer until export.
+	void StoreRadiance(int x, int y, const color& sum) {
+		const real scale = real(1) / samples_per_pixel;
+		framebuffer.SetPixel(x, y, static_cast<float>(scale * sum.x()), static_cast<float>(scale * sum.y()), static_cast<float>(scale * sum.z()));
+	}
+	// The framebuffer tone mapped to 8-bit RGB, top row first.
+	std::vector<unsigned char> ToneMappedPixels() const {
+		return ToneMap(framebuffer.Resolve(), toneMapping);
+	}
+
+	std::atomic<bool> cancelled{ false };
+	bool verbose = true;
+	double renderSeconds = 0.0;
+	double exportSeconds = 0.0;
+	render_counters counters;
+	camera* cam;
+	hittable* world;
+	const int image_width;
+	const int image_height;
+	const int samples_per_pixel;
+	integrator_settings integrator;
+	int packet_size = 0;
+	int wavefront_batch = 0;
+	// Linear radiance; writers that keep an image allocate it.
+	HDRFramebuffer framebuffer;
+	ToneMapping toneMapping;
+};
+
+class PPMNonThreadedWriter : public IImageWriter {
+public:
+	PPMNonThreadedWriter(camera* cam, hittable* world, int image_width, int image_height, int samples_per_pixel, int max_depth) :
+		IImageWriter(cam, world, image_width, image_height, samples_per_pixel, max_depth) {
+		framebuffer = HDRFramebuffer(image_width, image_height, image_width, 1);
+	}
+
+	bool Run() override {
+		auto start = Clock::now();
+		const render_counters before = thread_counters;
+		for (int j = image_height - 1; j >= 0; --j) {
+			if (verbose) std::cerr << "\rScanlines remaining: " << j << ' ' << std::flush;
+			for (int i = 0; i < image_width; ++i) {
+				WritePixel(i, j);
+			}
+		}
+		renderSeconds = SecondsSince(start);
+		counters = thread_counters - before;
+
+		auto exportStart = Clock::now();
+		const std::vector<unsigned char> pixels = ToneMappedPixels();
+		WriteHeader();
+		out->write(reinterpret_cast<const char*>(pixels.data()), pixels.size());
+		out->flush();
+		exportSeconds = SecondsSince(exportStart);
+		if (!*out) {
+			std::cerr << "\nCould not write the image.\n";
+			return false;
+		}
+
+		if (verbose) std::cerr << "\nDone.\n";
+		return true;
+	}
+	// The image goes to std::cout unless another stream is set.
+	void SetOutput(std::ostream& stream) { out = &stream; }
+	void WriteHeader() override {
+		if (out == &std::cout) SetStdoutBinary();
+		*out << "P6\n" << image_width << ' ' << image_height << "\n255\n";
+	}
+	void StorePixel(int x, int y, const color& pixel_color) override {
+		StoreRadiance(x, y, pixel_color);
+	}
+	void OnFinishedExecution() override {
+		// Not used in non-threaded version
+	}
+
+private:
+	std::ostream* out = &std::cout;
+};
+
+class PNGNonThreadedWriter : public IImageWriter {
+public:
+	PNGNonThreadedWriter(std::string filename, camera* cam, hittable* world, int image_width, int image_height, int samples_per_pixel, int max_depth) :
+		IImageWriter(cam, world, image_width, image_height, samples_per_pixel, max_depth),
+		image(image_width, image_height),
+		filename(filename)
+	{
+		framebuffer = HDRFramebuffer(image_width, image_height, image_width, 1);
+	}
+
+	bool Run() override {
+		auto start = Clock::now();
+		const render_counters before = thread_counters;
+		for (int j = image_height - 1; j >= 0; --j) {
+			if (verbose) std::cerr << "\rScanlines remaining: " << j << ' ' << std::flush;
+			for (int i = 0; i < image_width; ++i) {
+				WritePixel(i, j);
+			}
+		}
+		renderSeconds = SecondsSince(start);
+		counters = thread_counters - before;
+
+		if (verbose) std::cerr << "\nExporting...\n";
+		auto exportStart = Clock::now();
+		const bool exported = ExportPNG();
+		exportSeconds = SecondsSince(exportStart);
+		if (!exported) return false;
+		if (verbose) std::cerr << "\nDone.\n";
+		return true;
+	}
+	void WriteHeader() override {
+		// Not used for PNG, opencv handles png writing
+	}
+	bool ExportPNG() {
+		image.SetPixels(ToneMappedPixels());
+		if (image.SaveImage(filename)) return true;
+		std::cerr << "Could not write " << filename << "\n";
+		return false;
+	}
+	void StorePixel(int x, int y, const color& pixel_color) override {
+		StoreRadiance(x, y, pixel_color);
+	}
+	void OnFinishedExecution() override {
+		// Not used in non-threaded version
+	}
+
+private:
+	PNGImage image;
+	std::string filename;
+};
+
+class PPMWriteRowAction : public IWorkerAction {
+
+public:
+	PPMWriteRowAction(IImageWriter* writer, int img_width, int y) : ppmWriter(writer), image_width(img_width), y(y) {};
+
+	virtual void OnStartTask() override {
+		if (ppmWriter == nullptr) return;
+
+		//std::cerr << "\rScanlines remaining (started one): " << y << ' ' << std::endl;
+
+		for (int i = 0; i < image_width; ++i) {
+			ppmWriter->WritePixel(i, y);
+		}
+
+		//std::cerr << "\rOne task completed!" << std::endl;
+
+		ppmWriter->OnFinishedExecution();
+	}
+
+private:
+	IImageWriter* ppmWriter;
+	int image_width;
+	int y;
+};
+
+class PPMWriteBlockAction : public IWorkerAction {
+public:
+	PPMWriteBlockAction(IImageWriter* writer, int startX, int startY, int blockWidth, int blockHeight) :
+		ppmWriter(writer), startX(startX), startY(startY), blockWidth(blockWidth), blockHeight(blockHeight) {
+	};
+
+	virtual void OnStartTask() override {
+		if (ppmWriter == nullptr) return;
+		if (ppmWriter->IsCancelled()) {
+			ppmWriter->OnFinishedExecution();
+			return;
+		}
+		//std::string str = "\nWrite Block: x(" + std::to_string(startX) + ", " + std::to_string(startX + blockWidth) + "), y(" + std::to_string(startY) + ", " + std::to_string(startY + blockHeight) + ")";
+		//std::cerr << str;
+		ppmWriter->WriteBlock(startX, startY, blockWidth, blockHeight);
+		ppmWriter->OnFinishedExecution();
+	}
+private:
+	IImageWriter* ppmWriter;
+	int startX;
+	int startY;
+	int blockWidth;
+	int blockHeight;
+};
+
+// Settings for ThreadedImageWriter::SetProgressive. Each pass adds
+// passSamples to every pixel of the tiles that have not converged yet.
+struct ProgressiveSettings {
+	int minSamples = 16;
+	int maxSamples = 1024;
+	int passSamples = 8;
+	// A tile has converged once none of its pixels has a displayed standard
+	// error above this, in [0,1] display units.
+	double noiseThreshold = 0.005;
+	// No new pass starts after this many seconds. Zero means no limit.
+	double timeBudget = 0.0;
+	// Exports the image after every this many passes. Zero only exports at the end.
+	int snapshotInterval = 0;
+};
+
+// What a scheduled tile task does: time the cost probes, render all
+// samples_per_pixel samples, or run one progressive pass.
+enum class TileWork { Probe, Render, Pass };
+
+// Order tiles are handed to the thread pool in. CostDescending schedules the
+// tiles estimated to be most expensive first, so cheap ones fill the tail; it
+// falls back to Rows when there are no estimates.
+enum class TileOrder { Rows, Hilbert, Spiral, CostDescending };
+
+// Where per-tile cost estimates come from. PrePass times a few one-sample
+// probes per tile before rendering; LastRun reuses the tile timings of the
+// writer's previous Run() and estimates nothing on the first one.
+enum class TileCostSource { None, PrePass, LastRun };
+
+// Settings for ThreadedImageWriter::SetTileSchedule.
+struct TileSchedule {
+	TileOrder order = TileOrder::Rows;
+	TileCostSource costSource = TileCostSource::None;
+	// With cost estimates, tiles costing more than the total divided by
+	// threads * tilesPerThread are halved until they fit or reach minTileSize.
+	int tilesPerThread = 4;
+	int minTileSize = 4;
+	// The pre-pass traces a probesPerAxis x probesPerAxis grid per tile.
+	int probesPerAxis = 4;
+};
+
+// Tile timings of the last Run(). Times are wall seconds spent on each tile,
+// summed over progressive passes.
+struct TileStatistics {
+	int tiles = 0;
+	double minSeconds = 0.0;
+	double meanSeconds = 0.0;
+	double p95Seconds = 0.0;
+	double maxSeconds = 0.0;
+	double totalSeconds = 0.0;
+	double estimateSeconds = 0.0;
+	// Busy worker time over threads * render time. The rest is scheduling
+	// overhead and workers idling while the last tiles finish. Negative for
+	// distributed renders, whose tiles ran in the worker processes.
+	double utilization = 0.0;
+};
+
+class ThreadedImageWriter;
+class TileCoordinator;
+
+// One scheduled tile. Owned by the writer's per-frame TaskPool, so a task is
+// plain data and nothing is allocated or freed per tile.
+class TileAction : public IWorkerAction {
+public:
+	TileAction(ThreadedImageWriter* writer, int tileIndex, TileWork work, int slot) : writer(writer), tileIndex(tileIndex), work(work), slot(slot) {};
+
+	virtual void OnStartTask() override;
+private:
+	ThreadedImageWriter* writer;
+	int tileIndex;
+	TileWork work;
+	// Position in the batch ScheduleTiles handed out.
+	int slot;
+};
+
+// A snapshot of a threaded Run(), taken by the thread waiting in Run().
+struct RenderProgress {
+	// What the tiles of the current batch do; Probe during the cost pre-pass.
+	TileWork work = TileWork::Render;
+	// Progressive pass, counted from 1. Always 1 for fixed renders.
+	int pass = 1;
+	int tilesDone = 0;
+	int tilesTotal = 0;
+	long long samplesDone = 0;
+	// Zero when unknown, as in progressive renders.
+	long long samplesTotal = 0;
+	// Zero unless the build defines RT_STATS.
+	uint64_t rays = 0;
+	double elapsedSeconds = 0.0;
+	double samplesPerSecond = 0.0;
+	double raysPerSecond = 0.0;
+	// Negative when there is nothing to estimate from yet.
+	double etaSeconds = -1.0;
+};
+
+// Renders the image as tiles on a thread pool. By default every pixel gets
+// samples_per_pixel samples; in progressive mode tiles are refined pass by
+// pass until they converge. Derived writers only store and export pixels.
+class ThreadedImageWriter : public IImageWriter {
+public:
+	ThreadedImageWriter(camera* cam, hittable* world, int image_width, int image_height, int samples_per_pixel, int max_depth, int maxThreadCount, int block_width, int block_height) :
+		IImageWriter(cam, world, image_width, image_height, samples_per_pixel, max_depth),
+		block_width(block_width), block_height(block_height),
+		threadPool(maxThreadCount)
+	{
+		// Laid out by tile, so each worker fills cache lines of its own.
+		framebuffer = HDRFramebuffer(image_width, image_height, block_width, block_height);
+		threadPool.StartScheduling();
+	}
+
+	// Run() gives up and cancels the remaining tiles after timeout. Zero waits forever.
+	void SetTimeout(std::chrono::milliseconds timeout) { this->timeout = timeout; }
+	using ProgressCallback = std::function<void(const RenderProgress&)>;
+	// Called from the thread inside Run() every interval while tiles are
+	// rendering, as is the progress line on stderr in verbose mode. Workers
+	// only bump relaxed atomics once per tile, so reporting costs them nothing.
+	void SetProgressCallback(ProgressCallback callback, std::chrono::milliseconds interval) {
+		onProgress = callback;
+		progressInterval = interval;
+	}
+	// Progress of the Run() in flight. Only call it from the thread inside Run(),
+	// such as from the progress callback.
+	RenderProgress GetProgress() const;
+	// Switches Run() to progressive rendering; samples_per_pixel is then unused.
+	// Returns false, and changes nothing, if it asks for snapshots from a
+	// writer that cannot replace the image it has already written.
+	bool SetProgressive(const ProgressiveSettings& settings) {
+		if (settings.snapshotInterval > 0 && !CanExportRepeatedly()) return false;
+		progressive = settings;
+		progressive.minSamples = std::max(2, progressive.minSamples);
+		progressive.maxSamples = std::max(progressive.minSamples, progressive.maxSamples);
+		progressive.passSamples = std::max(1, progressive.passSamples);
+		progressiveEnabled = true;
+		return true;
+	}
+	// How tiles are ordered and, given cost estimates, subdivided.
+	void SetTileSchedule(const TileSchedule& settings) {
+		schedule = settings;
+		schedule.tilesPerThread = std::max(1, schedule.tilesPerThread);
+		schedule.minTileSize = std::max(1, schedule.minTileSize);
+		schedule.probesPerAxis = std::max(1, schedule.probesPerAxis);
+	}
+	// Renders the tiles on the coordinator's worker processes instead of the
+	// thread pool, which only takes over tiles no worker is left for. Not
+	// used in progressive mode. The coordinator must outlive Run().
+	void SetCoordinator(TileCoordinator* coordinator) { this->coordinator = coordinator; }
+	// Saves the render state to path about every interval while Run() renders,
+	// and once more if it times out. fingerprint identifies the job.
+	void SetCheckpoint(const std::string& path, std::chrono::milliseconds interval, uint64_t fingerprint);
+	// Makes the next Run() continue the render saved at path instead of
+	// starting over. Call it after SetProgressive. Returns false if the file
+	// cannot be read or was saved for another job.
+	bool ResumeFrom(const std::string& path, uint64_t fingerprint, std::string& error);
+	TileStatistics GetTileStatistics() const;
+	// Records when and on which thread every tile task of a Run() ran, for
+	// WriteChromeTrace. Off by default, since the record grows with every pass.
+	void SetTraceEnabled(bool enabled) { traceEnabled = enabled; }
+	// Writes the tile tasks of the last Run() in the Chrome trace event
+	// format, one row per worker thread, for chrome://tracing or Perfetto.
+	void WriteChromeTrace(std::ostream& out) const;
+
+	bool Run() override {
+		runStart = Clock::now();
+		counters = render_counters();
+		spans.clear();
+		progress.samples = 0;
+		progress.rays = 0;
+		currentPass = 1;
+		completedPasses = 0;
+		resumedSeconds = 0.0;
+		resumedSamples = 0;
+		lastCheckpoint = runStart;
+		bool rendered = progressiveEnabled ? RenderProgressive()
+			: coordinator ? RenderDistributed()
+			: RenderFixed();
+		if (!rendered)
+			return false;
+		renderSeconds = SecondsSince(runStart);
+		RememberTileCosts();
+		if (verbose) PrintTileStatistics();
+
+		if (verbose) std::cerr << "\nExporting...\n";
+		auto exportStart = Clock::now();
+		const bool exported = Export();
+		exportSeconds = SecondsSince(exportStart);
+		if (!exported) return false;
+		if (verbose) std::cerr << "\nDone.\n";
+		return true;
+	}
+
+	long long GetSampleCount() const override {
+		if (!progressiveEnabled) return IImageWriter::GetSampleCount();
+		long long total = 0;
+		for (const Tile& tile : tiles)
+			total += static_cast<long long>(tile.samples) * tile.width * tile.height;
+		return total;
+	}
+
+	void CreateBlockScans(int blockX, int blockY) {
+		int xBlocks = (image_width + blockX - 1) / blockX;
+		int xOvershoot = image_width % blockX;
+
+		int yBlocks = (image_height + blockY - 1) / blockY;
+		int yOvershoot = image_height % blockY;
+
+		tiles.clear();
+		for (int i = 0; i < yBlocks; i++) {
+			for (int j = 0; j < xBlocks; j++) {
+				Tile tile;
+				tile.x = j * blockX;
+				tile.y = i * blockY;
+				tile.width = blockX;
+				tile.height = blockY;
+
+				if (i == yBlocks - 1 && yOvershoot != 0) tile.height = yOvershoot;
+				if (j == xBlocks - 1 && xOvershoot != 0) tile.width = xOvershoot;
+				tile.parent = static_cast<int>(tiles.size());
+				tiles.push_back(tile);
+			}
+		}
+	}
+
+	// Takes the tile up to its next sample count and decides whether it needs
+	// another pass. Sample indices continue where the last pass stopped, so the
+	// image does not depend on the thread count.
+	void RenderTilePass(int tileIndex) {
+		Tile& tile = tiles[tileIndex];
+		auto start = Clock::now();
+		int target = std::min(std::max(tile.samples + progressive.passSamples, progressive.minSamples), progressive.maxSamples);
+		TraceBlock(tile.x, tile.y, tile.width, tile.height, tile.samples, target,
+			[this](int x, int y, const color& c) { accumulation.at(x, y).add(c); });
+
+		double worstError = 0.0;
+		for (int y = tile.y; y < tile.y + tile.height; ++y) {
+			for (int x = tile.x; x < tile.x + tile.width; ++x) {
+				worstError = std::max(worstError, accumulation.at(x, y).display_error());
+			}
+		}
+		tile.samples = target;
+		tile.active = tile.samples < progressive.maxSamples && worstError > progressive.noiseThreshold;
+		tile.seconds += SecondsSince(start);
+	}
+
+	void RenderTile(int tileIndex) {
+		Tile& tile = tiles[tileIndex];
+		auto start = Clock::now();
+		if (checkpointWriter) {
+			// Keeps the sums for checkpoints. TraceBlock adds each pixel's
+			// samples in the same order as WriteBlock, so the image is the same.
+			TraceBlock(tile.x, tile.y, tile.width, tile.height, 0, samples_per_pixel,
+				[this](int x, int y, const color& c) { accumulation.at(x, y).sum += c; });
+			for (int y = tile.y; y < tile.y + tile.height; ++y) {
+				for (int x = tile.x; x < tile.x + tile.width; ++x) {
+					accumulation.at(x, y).samples = samples_per_pixel;
+					StorePixel(x, y, accumulation.at(x, y).sum);
+				}
+			}
+		}
+		else {
+			WriteBlock(tile.x, tile.y, tile.width, tile.height);
+		}
+		tile.samples = samples_per_pixel;
+		tile.seconds = SecondsSince(start);
+		// Publishes the tile's pixels to checkpoints taken while others render.
+		tileFinished[tileIndex].store(true, std::memory_order_release);
+	}
+
+	// Times one sample at a grid of pixels in the tile and scales it to the
+	// whole tile. The samples are thrown away, so the image is unaffected.
+	void ProbeTile(int tileIndex) {
+		Tile& tile = tiles[tileIndex];
+		const int n = schedule.probesPerAxis;
+		auto start = Clock::now();
+		for (int j = 0; j < n; ++j) {
+			for (int i = 0; i < n; ++i) {
+				int x = tile.x + (2 * i + 1) * tile.width / (2 * n);
+				int y = tile.y + (2 * j + 1) * tile.height / (2 * n);
+				TraceSample(x, y, 0);
+			}
+		}
+		double perSample = SecondsSince(start) / (n * n);
+		int samples = progressiveEnabled ? progressive.minSamples : samples_per_pixel;
+		tile.cost = perSample * tile.width * tile.height * samples;
+	}
+
+	// Runs one tile task on the calling worker and keeps its counters in the
+	// task's batch slot, so no two workers write the same counters.
+	void ExecuteTile(int tileIndex, TileWork work, int slot);
+
+	void OnFinishedExecution() override {
+		// Last touch of this writer from the worker; Run() may return right after.
+		completion.OnFinishedExecution();
+	}
+	// Tiles write disjoint pixels, so no lock is needed.
+	void StorePixel(int x, int y, const color& pixel_color) final {
+		StoreRadiance(x, y, pixel_color);
+	}
+
+protected:
+	// Writes the image out. Progressive renders also call it for snapshots.
+	// Returns false, after saying why, if the image could not be written.
+	virtual bool Export() = 0;
+	// False for writers whose output cannot be rewritten, such as a stream;
+	// they only take progressive settings without snapshots.
+	virtual bool CanExportRepeatedly() const { return true; }
+	void WriteStatsDetail(std::ostream& out) const override;
+
+private:
+	struct Tile {
+		int x = 0;
+		int y = 0;
+		int width = 0;
+		int height = 0;
+		int samples = 0;
+		bool active = true;
+		// The CreateBlockScans tile this one was split from.
+		int parent = 0;
+		// Estimated and measured cost in seconds.
+		double cost = 0.0;
+		double seconds = 0.0;
+	};
+
+	// One tile task as recorded for the trace. Times are seconds since runStart.
+	struct TileSpan {
+		int x = 0;
+		int y = 0;
+		int width = 0;
+		int height = 0;
+		TileWork work = TileWork::Render;
+		int thread = 0;
+		double start = 0.0;
+		double end = 0.0;
+		uint64_t rays = 0;
+		uint64_t nodeVisits = 0;
+		uint64_t primitiveTests = 0;
+	};
+
+	bool RenderFixed();
+	bool RenderProgressive();
+	bool RenderDistributed();
+
+	// Builds the tile list for a Run(): block scans, cost estimates,
+	// subdivision and ordering. Returns false if the pre-pass timed out.
+	bool PrepareTiles();
+	bool EstimateTileCosts();
+	void SubdivideTiles();
+	void OrderTiles();
+	// Hands the tiles in indices to the pool so they start roughly in order.
+	void ScheduleTiles(const std::vector<int>& indices, TileWork work);
+	void RememberTileCosts();
+	void PrintTileStatistics() const;
+
+	// Waits for the scheduled tiles within what is left of the timeout. On
+	// timeout the rest are cancelled and the ones already running are waited
+	// for, so no tile touches the image after Run() returns.
+	bool WaitForTiles() {
+		auto wait = timeout;
+		if (timeout != std::chrono::milliseconds::zero()) {
+			wait = timeout - std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - runStart);
+			if (wait <= std::chrono::milliseconds::zero()) wait = std::chrono::milliseconds(1);
+		}
+		const bool reporting = verbose || onProgress;
+		auto tick = [this, reporting](int, int) {
+			if (reporting) ReportProgress();
+			// Progressive tiles are only consistent between passes.
+			if (currentWork == TileWork::Render) SaveCheckpointIfDue();
+		};
+		const bool ticking = reporting || checkpointWriter;
+		if (!completion.Wait(wait, ticking ? progressInterval : std::chrono::milliseconds::zero(), tick)) {
+			Cancel();
+			threadPool.WaitAll();
+			CollectBatchCounters();
+			if (verbose) std::cerr << "\nTimed out.\n";
+			SaveCheckpointNow();
+			return false;
+		}
+		CollectBatchCounters();
+		if (reporting) ReportProgress();
+		return true;
+	}
+	// Hands a progress snapshot to the callback and, in verbose mode, prints it.
+	void ReportProgress() const;
+
+	// Restores the tiles, pixels and passes of the checkpoint being resumed.
+	void RestoreCheckpoint();
+	// Snapshot of the render for a checkpoint. Safe to take while tiles of a
+	// fixed render are running: only the finished ones are saved.
+	RenderCheckpoint CaptureCheckpoint() const;
+	// Hands a snapshot to the checkpoint writer if the interval has passed
+	// and the last one is written.
+	void SaveCheckpointIfDue();
+	// Saves a snapshot and waits until it is on disk.
+	void SaveCheckpointNow();
+
+	// Folds the finished batch's counters into the frame's.
+	void CollectBatchCounters() {
+		for (const render_counters& c : batchCounters) counters += c;
+		batchCounters.clear();
+	}
+
+	// Hands the progressive estimate to StorePixel, scaled to the sum of
+	// samples_per_pixel samples it expects.
+	void ResolveFilm() {
+		for (int y = 0; y < image_height; ++y)
+			for (int x = 0; x < image_width; ++x)
+				StorePixel(x, y, accumulation.at(x, y).mean() * static_cast<real>(samples_per_pixel));
+	}
+
+	ExecutionLatch completion;
+	std::chrono::milliseconds timeout = std::chrono::milliseconds::zero();
+	std::chrono::milliseconds progressInterval = std::chrono::milliseconds(250);
+	ProgressCallback onProgress;
+	Clock::time_point runStart;
+
+	int block_width;
+	int block_height;
+	std::vector<Tile> tiles;
+
+	TileSchedule schedule;
+	double estimateSeconds = 0.0;
+	// Seconds per CreateBlockScans tile in the previous Run(), for LastRun.
+	std::vector<double> lastRunCosts;
+
+	TileCoordinator* coordinator = nullptr;
+
+	bool progressiveEnabled = false;
+	ProgressiveSettings progressive;
+	// Progressive estimates, or in fixed renders with checkpoints the sums
+	// of the finished tiles.
+	film accumulation;
+	int completedPasses = 0;
+
+	std::unique_ptr<CheckpointWriter> checkpointWriter;
+	std::chrono::milliseconds checkpointInterval = std::chrono::minutes(1);
+	uint64_t checkpointFingerprint = 0;
+	Clock::time_point lastCheckpoint;
+	// Set by ResumeFrom until the next Run() restores it.
+	std::unique_ptr<RenderCheckpoint> resumeState;
+	// What earlier runs of a resumed render did, for the time budget and progress.
+	double resumedSeconds = 0.0;
+	long long resumedSamples = 0;
+	// Set by a worker once a fixed render's tile is done, by tile index.
+	std::vector<std::atomic<bool>> tileFinished;
+
+	// Bumped by workers once per tile and read by ReportProgress, on a cache
+	// line of their own so the bumps do not slow down anything else.
+	struct alignas(64) ProgressCounters {
+		std::atomic<long long> samples{ 0 };
+		std::atomic<uint64_t> rays{ 0 };
+	};
+	ProgressCounters progress;
+	TileWork currentWork = TileWork::Render;
+	int currentPass = 1;
+
+	// The tasks of the tiles scheduled since the last WaitForTiles(). Declared
+	// before threadPool so the tasks outlive any the pool still drains.
+	TaskPool<TileAction> tileTasks;
+	// Counters of the scheduled tasks, by slot.
+	std::vector<render_counters> batchCounters;
+	bool traceEnabled = false;
+	std::vector<TileSpan> spans;
+	// Index in spans of the current batch's first task.
+	size_t spanBase = 0;
+
+	// Declared last so it is destroyed first: its destructor drains any
+	// cancelled tiles, which still call back into this writer.
+	ThreadPool threadPool;
+};
+
+class PPMThreadedWriter : public ThreadedImageWriter {
+public:
+	PPMThreadedWriter(camera* cam, hittable* world, int image_width, int image_height, int samples_per_pixel, int max_depth, int maxThreadCount) :
+		PPMThreadedWriter(cam, world, image_width, image_height, samples_per_pixel, max_depth, maxThreadCount, image_width, 1)
+	{
+	}
+	PPMThreadedWriter(camera* cam, hittable* world, int image_width, int image_height, int samples_per_pixel, int max_depth, int maxThreadCount, int block_width, int block_height) :
+		ThreadedImageWriter(cam, world, image_width, image_height, samples_per_pixel, max_depth, maxThreadCount, block_width, block_height)
+	{
+	}
+
+	// The image goes to std::cout unless another stream is set.
+	void SetOutput(std::ostream& stream) { out = &stream; }
+	void WriteHeader() override {
+		if (out == &std::cout) SetStdoutBinary();
+		*out << "P6\n" << image_width << ' ' << image_height << "\n255\n";
+	}
+protected:
+	// Another Export() would append a second image to the stream.
+	bool CanExportRepeatedly() const override { return false; }
+	bool Export() override {
+		// Tone mapped pixels are in P6 layout, so they go out in one write.
+		const std::vector<unsigned char> pixels = ToneMappedPixels();
+		WriteHeader();
+		out->write(reinterpret_cast<const char*>(pixels.data()), pixels.size());
+		out->flush();
+		if (*out) return true;
+		std::cerr << "\nCould not write the image.\n";
+		return false;
+	}
+
+private:
+	std::ostream* out = &std::cout;
+};
+
+class PNGThreadedWriter : public ThreadedImageWriter {
+public:
+	PNGThreadedWriter(std::string filename, camera* cam, hittable* world, int image_width, int image_height, int samples_per_pixel, int max_depth, int maxThreadCount) :
+		PNGThreadedWriter(filename, cam, world, image_width, image_height, samples_per_pixel, max_depth, maxThreadCount, image_width, 1)
+	{
+	}
+	PNGThreadedWriter(std::string filename, camera* cam, hittable* world, int image_width, int image_height, int samples_per_pixel, int max_depth, int maxThreadCount, int block_width, int block_height) :
+		ThreadedImageWriter(cam, world, image_width, image_height, samples_per_pixel, max_depth, maxThreadCount, block_width, block_height),
+		image(image_width, image_height),
+		filename(filename)
+	{
+	}
+
+	void WriteHeader() override {
+		// Not used in PNG, let opencv handle this
+	}
+
+protected:
+	bool Export() override {
+		image.SetPixels(ToneMappedPixels());
+		if (image.SaveImage(filename)) return true;
+		std::cerr << "Could not write " << filename << "\n";
+		return false;
+	}
+
+private:
+	PNGImage image;
+	std::string filename;
+};
+
+// Writes the linear framebuffer, without tone mapping, as a .pfm or .exr
+// file, so renders can be re-exposed or merged later.
+class HDRThreadedWriter : public ThreadedImageWriter {
+public:
+	HDRThreadedWriter(std::string filename, camera* cam, hittable* world, int image_width, int image_height, int samples_per_pixel, int max_depth, int maxThreadCount, int block_width, int block_height) :
+		ThreadedImageWriter(cam, world, image_width, image_height, samples_per_pixel, max_depth, maxThreadCount, block_width, block_height),
+		filename(filename)
+	{
+	}
+
+	void WriteHeader() override {}
+
+protected:
+	bool Export() override;
+
+private:
+	std::string filename;
+};
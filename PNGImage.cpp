@@ -1,42 +1,126 @@
 #include "PNGImage.h"
 
-#include "rtweekend.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <utility>
+
+#ifdef RT_HAS_OPENCV
+#include <opencv2/core.hpp>
 #include <opencv2/imgcodecs.hpp>
+#endif
 
 PNGImage::PNGImage(const int imageWidth, const int imageHeight) :
+	pixels(3 * static_cast<size_t>(imageWidth) * imageHeight, 0),
 	imageWidth(imageWidth), imageHeight(imageHeight)
 {
-	pixels = std::make_unique<cv::Mat>(cv::Mat::zeros(imageHeight, imageWidth, CV_8UC3));
 }
 
-void PNGImage::SetPixel(int x, int y, float r, float g, float b, int samplesPerPixel)
+void PNGImage::SetPixels(std::vector<unsigned char> rgb)
 {
-	// gamma correction
-	float scale = 1.0f / samplesPerPixel;
-	r = sqrt(scale * r);
-	g = sqrt(scale * g);
-	b = sqrt(scale * b);
-
-	int rInt = static_cast<uchar>(256 * clamp(r, 0.0f, 0.999f));
-	int gInt = static_cast<uchar>(256 * clamp(g, 0.0f, 0.999f));
-	int bInt = static_cast<uchar>(256 * clamp(b, 0.0f, 0.999f));
+	if (rgb.size() == pixels.size()) pixels = std::move(rgb);
+}
 
-	cv::Vec3b& color = this->pixels->at<cv::Vec3b>(this->imageHeight - 1 - y, x);
-	color[0] = bInt; 
-	color[1] = gInt; 
-	color[2] = rInt;
+bool PNGImage::SaveImage(const std::string& fileName) const
+{
+#ifdef RT_HAS_OPENCV
+	// OpenCV expects BGR.
+	cv::Mat image(imageHeight, imageWidth, CV_8UC3);
+	for (int y = 0; y < imageHeight; ++y) {
+		for (int x = 0; x < imageWidth; ++x) {
+			const unsigned char* rgb = &pixels[3 * (static_cast<size_t>(y) * imageWidth + x)];
+			image.at<cv::Vec3b>(y, x) = cv::Vec3b(rgb[2], rgb[1], rgb[0]);
+		}
+	}
+	return cv::imwrite(fileName, image);
+#else
+	return SaveBuiltin(fileName);
+#endif
+}
 
-	/*cv::Mat imgChannels[3];
-	cv::split(*this->pixels, imgChannels);
+namespace {
+	uint32_t crc32(const unsigned char* data, size_t length, uint32_t crc = 0) {
+		static const std::array<uint32_t, 256> table = [] {
+			std::array<uint32_t, 256> t{};
+			for (uint32_t n = 0; n < 256; n++) {
+				uint32_t c = n;
+				for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+				t[n] = c;
+			}
+			return t;
+		}();
+		crc = ~crc;
+		for (size_t i = 0; i < length; i++) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+		return ~crc;
+	}
 
-	imgChannels[0].at<uchar>(this->imageHeight - 1 - y, x) = bInt;
-	imgChannels[1].at<uchar>(this->imageHeight - 1 - y, x) = gInt;
-	imgChannels[2].at<uchar>(this->imageHeight - 1 - y, x) = rInt;
+	void appendBigEndian(std::vector<unsigned char>& out, uint32_t value) {
+		out.push_back(static_cast<unsigned char>(value >> 24));
+		out.push_back(static_cast<unsigned char>(value >> 16));
+		out.push_back(static_cast<unsigned char>(value >> 8));
+		out.push_back(static_cast<unsigned char>(value));
+	}
 
-	cv::merge(imgChannels, 3, *this->pixels);*/
+	void writeChunk(std::ofstream& file, const char type[4], const std::vector<unsigned char>& data) {
+		std::vector<unsigned char> chunk;
+		chunk.reserve(data.size() + 12);
+		appendBigEndian(chunk, static_cast<uint32_t>(data.size()));
+		chunk.insert(chunk.end(), type, type + 4);
+		chunk.insert(chunk.end(), data.begin(), data.end());
+		appendBigEndian(chunk, crc32(chunk.data() + 4, data.size() + 4));
+		file.write(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+	}
 }
 
-void PNGImage::SaveImage(cv::String& fileName) const
+bool PNGImage::SaveBuiltin(const std::string& fileName) const
 {
-	cv::imwrite(fileName, *this->pixels);
-}
\ No newline at end of file
+	std::ofstream file(fileName, std::ios::binary);
+	if (!file) return false;
+
+	const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	file.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+	std::vector<unsigned char> header;
+	appendBigEndian(header, static_cast<uint32_t>(imageWidth));
+	appendBigEndian(header, static_cast<uint32_t>(imageHeight));
+	header.insert(header.end(), { 8, 2, 0, 0, 0 }); // 8-bit RGB, no interlace
+	writeChunk(file, "IHDR", header);
+
+	// Scanlines each get a zero filter byte, then go into a zlib stream made of
+	// stored (uncompressed) deflate blocks of at most 65535 bytes.
+	const size_t rowBytes = 3 * static_cast<size_t>(imageWidth);
+	std::vector<unsigned char> raw;
+	raw.reserve((rowBytes + 1) * imageHeight);
+	for (int y = 0; y < imageHeight; ++y) {
+		raw.push_back(0);
+		raw.insert(raw.end(), pixels.begin() + y * rowBytes, pixels.begin() + (y + 1) * rowBytes);
+	}
+
+	std::vector<unsigned char> zlib;
+	zlib.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+	zlib.push_back(0x78);
+	zlib.push_back(0x01);
+	size_t offset = 0;
+	do {
+		size_t blockSize = std::min<size_t>(65535, raw.size() - offset);
+		bool last = offset + blockSize == raw.size();
+		zlib.push_back(last ? 1 : 0);
+		zlib.push_back(static_cast<unsigned char>(blockSize));
+		zlib.push_back(static_cast<unsigned char>(blockSize >> 8));
+		zlib.push_back(static_cast<unsigned char>(~blockSize));
+		zlib.push_back(static_cast<unsigned char>(~blockSize >> 8));
+		zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + blockSize);
+		offset += blockSize;
+	} while (offset < raw.size());
+
+	uint32_t a = 1, b = 0;
+	for (unsigned char byte : raw) {
+		a = (a + byte) % 65521;
+		b = (b + a) % 65521;
+	}
+	appendBigEndian(zlib, (b << 16) | a);
+	writeChunk(file, "IDAT", zlib);
+	writeChunk(file, "IEND", {});
+	return static_cast<bool>(file);
+}
@@ -1,17 +1,24 @@
 #pragma once
 
-#include <opencv2/core.hpp>
+#include <string>
+#include <vector>
 
+// 8-bit RGB image saved as a PNG file. Uses OpenCV when built with
+// RT_HAS_OPENCV, otherwise a built-in encoder that writes uncompressed PNGs.
 class PNGImage
 {
 public:
 	PNGImage(const int imageWidth, const int imageHeight);
-	void SetPixel(int x, int y, float r, float g, float b, int samplesPerPixel);
-	void SaveImage(cv::String &fileName) const;
+	// 8-bit RGB triples, top row first, as ToneMap returns them.
+	void SetPixels(std::vector<unsigned char> rgb);
+	// Returns false if the file could not be written.
+	bool SaveImage(const std::string& fileName) const;
 
 private:
-	std::unique_ptr<cv::Mat> pixels;
+	bool SaveBuiltin(const std::string& fileName) const;
+
+	// RGB triples, top row first.
+	std::vector<unsigned char> pixels;
 	int imageWidth;
 	int imageHeight;
 };
-
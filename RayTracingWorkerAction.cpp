@@ -1,10 +1,12 @@
 #include "RayTracingWorkerAction.h"
 
+RayTracingWorkerAction::RayTracingWorkerAction(int id, IExecutionEvent* onFinish)
+	: id(id), onFinish(onFinish) {}
+
 void RayTracingWorkerAction::OnStartTask()
 {
 	// What raytracing logic I want for this
 
+	// The scheduler owns the task, so it is not deleted here.
 	onFinish->OnFinishedExecution();
-
-	delete this;
 }
@@ -0,0 +1,455 @@
+#include "RenderBenchmark.h"
+
+#include "rtweekend.h"
+#include "bvh.h"
+#include "camera.h"
+#include "scenes.h"
+#include "sphere_soup.h"
+#include "ray_packet.h"
+#include "ImageWriters.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace {
+	using bench_clock = std::chrono::steady_clock;
+
+	double seconds_since(bench_clock::time_point start) {
+		return std::chrono::duration<double>(bench_clock::now() - start).count();
+	}
+
+	// Forwards to the scene and counts the top level queries, one per path
+	// segment. Every thread counts into its own cache line.
+	class ray_counter : public hittable {
+	public:
+		ray_counter(const hittable& inner) : inner(inner), id(next_id++) {}
+
+		virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override {
+			add(1);
+			return inner.hit(r, t_min, t_max, rec);
+		}
+		virtual void hit_packet(ray_packet& packet, real t_min) const override {
+			add(packet.size);
+			inner.hit_packet(packet, t_min);
+		}
+		virtual bool bounding_box(aabb& output_box) const override {
+			return inner.bounding_box(output_box);
+		}
+
+		uint64_t total() const {
+			std::lock_guard<std::mutex> guard(slotsMtx);
+			uint64_t sum = 0;
+			for (const auto& slot : slots) sum += slot->count.load(std::memory_order_relaxed);
+			return sum;
+		}
+
+	private:
+		struct alignas(64) counter_slot {
+			std::atomic<uint64_t> count{ 0 };
+		};
+
+		void add(uint64_t n) const {
+			// Ids rather than addresses identify the counter, since a new one
+			// may reuse the storage of the last.
+			thread_local int cached_id = -1;
+			thread_local counter_slot* cached_slot = nullptr;
+			if (cached_id != id) {
+				std::lock_guard<std::mutex> guard(slotsMtx);
+				slots.push_back(std::make_unique<counter_slot>());
+				cached_slot = slots.back().get();
+				cached_id = id;
+			}
+			// Only this thread writes the slot, so no read-modify-write is needed.
+			cached_slot->count.store(cached_slot->count.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+		}
+
+		const hittable& inner;
+		const int id;
+		mutable std::mutex slotsMtx;
+		mutable std::vector<std::unique_ptr<counter_slot>> slots;
+
+		static std::atomic<int> next_id;
+	};
+
+	std::atomic<int> ray_counter::next_id{ 0 };
+
+	struct benchmark_options {
+		int width = 200;
+		int samples = 16;
+		int max_depth = 50;
+		int packet_size = 8;
+		int repeats = 1;
+		unsigned int seed = 1;
+		std::vector<int> threads;
+		std::vector<int> tiles = { 8, 16, 32, 64, 0 };
+		std::vector<std::string> scenes = { "book", "random", "stacked" };
+		std::string json_path;
+		std::string csv_path;
+	};
+
+	struct benchmark_result {
+		std::string scene;
+		std::string writer;
+		int threads = 1;
+		int tile = -1; // -1 when the writer has no tiles, 0 for whole rows
+		int width = 0;
+		int height = 0;
+		long long samples = 0;
+		uint64_t rays = 0;
+		double scene_seconds = 0.0;
+		double bvh_seconds = 0.0;
+		double render_seconds = 0.0;
+		double export_seconds = 0.0;
+		double wall_seconds = 0.0;
+		double scaling_efficiency = -1.0; // -1 when not measured
+		// Tile timings, -1 for writers without tiles.
+		double tile_max_seconds = -1.0;
+		double tile_p95_seconds = -1.0;
+		double utilization = -1.0;
+	};
+
+	struct scene_case {
+		const char* name;
+		hittable_list(*build)();
+	};
+
+	const scene_case scene_cases[] = {
+		{ "book", book_scene },
+		{ "random", random_scene },
+		{ "stacked", random_stacked_balls },
+		{ "instanced", instanced_scene },
+	};
+
+	bool parse_list(const std::string& text, std::vector<int>& values) {
+		values.clear();
+		std::stringstream stream(text);
+		std::string item;
+		while (std::getline(stream, item, ',')) {
+			char* end = nullptr;
+			long value = std::strtol(item.c_str(), &end, 10);
+			if (item.empty() || *end != '\0' || value < 0) return false;
+			values.push_back(static_cast<int>(value));
+		}
+		return !values.empty();
+	}
+
+	bool parse_options(int argc, char* argv[], benchmark_options& options) {
+		for (int i = 0; i < argc; ++i) {
+			std::string arg = argv[i];
+			if (i + 1 >= argc) {
+				std::cerr << "Missing value for " << arg << "\n";
+				return false;
+			}
+			std::string value = argv[++i];
+			std::vector<int> list;
+			if (arg == "--width") options.width = std::atoi(value.c_str());
+			else if (arg == "--spp") options.samples = std::atoi(value.c_str());
+			else if (arg == "--depth") options.max_depth = std::atoi(value.c_str());
+			else if (arg == "--packet") options.packet_size = std::atoi(value.c_str());
+			else if (arg == "--repeat") options.repeats = std::max(1, std::atoi(value.c_str()));
+			else if (arg == "--seed") options.seed = static_cast<unsigned int>(std::strtoul(value.c_str(), nullptr, 10));
+			else if (arg == "--threads" && parse_list(value, list)) options.threads = list;
+			else if (arg == "--tiles" && parse_list(value, list)) options.tiles = list;
+			else if (arg == "--json") options.json_path = value;
+			else if (arg == "--csv") options.csv_path = value;
+			else if (arg == "--scenes") {
+				options.scenes.clear();
+				std::stringstream stream(value);
+				std::string name;
+				while (std::getline(stream, name, ',')) options.scenes.push_back(name);
+			}
+			else {
+				std::cerr << "Bad benchmark argument " << arg << " " << value << "\n";
+				return false;
+			}
+		}
+		if (options.width < 2 || options.samples < 1) {
+			std::cerr << "--width must be at least 2 and --spp at least 1\n";
+			return false;
+		}
+		for (int threads : options.threads) {
+			if (threads < 1) {
+				std::cerr << "Thread counts must be at least 1\n";
+				return false;
+			}
+		}
+		if (options.threads.empty()) {
+			int cores = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+			for (int threads = 1; threads < cores; threads *= 2) options.threads.push_back(threads);
+			options.threads.push_back(cores);
+		}
+		return true;
+	}
+
+	// Swallows what the PPM writers export, so their runs write no files.
+	class null_buffer : public std::streambuf {
+	protected:
+		int overflow(int c) override { return traits_type::not_eof(c); }
+		std::streamsize xsputn(const char*, std::streamsize count) override { return count; }
+	};
+
+	// Renders one configuration options.repeats times and keeps the fastest
+	// run. Returns nothing if the writer could not be set up or a run failed,
+	// since its timings would not be comparable.
+	template <typename MakeWriter>
+	std::optional<benchmark_result> run_writer(const benchmark_options& options, hittable& world, camera& cam, int height, MakeWriter make_writer) {
+		benchmark_result best;
+		for (int r = 0; r < options.repeats; ++r) {
+			ray_counter counted(world);
+			benchmark_result result;
+			auto start = bench_clock::now();
+			{
+				auto writer = make_writer(&cam, &counted);
+				if (!writer) return std::nullopt;
+				writer->SetVerbose(false);
+				writer->SetPacketSize(options.packet_size);
+				if (!writer->Run()) return std::nullopt;
+				result.render_seconds = writer->GetRenderSeconds();
+				result.export_seconds = writer->GetExportSeconds();
+				result.samples = writer->GetSampleCount();
+				using writer_type = typename decltype(writer)::element_type;
+				if constexpr (std::is_base_of_v<ThreadedImageWriter, writer_type>) {
+					TileStatistics tiles = writer->GetTileStatistics();
+					result.tile_max_seconds = tiles.maxSeconds;
+					result.tile_p95_seconds = tiles.p95Seconds;
+					result.utilization = tiles.utilization;
+				}
+			}
+			// Includes starting and joining the thread pool.
+			result.wall_seconds = seconds_since(start);
+			result.rays = counted.total();
+			result.width = options.width;
+			result.height = height;
+			if (r == 0 || result.wall_seconds < best.wall_seconds) best = result;
+		}
+		return best;
+	}
+
+	void compute_scaling(std::vector<benchmark_result>& results) {
+		for (auto& result : results) {
+			const benchmark_result* base = nullptr;
+			for (const auto& other : results) {
+				if (other.scene == result.scene && other.writer == result.writer && other.tile == result.tile
+					&& (base == nullptr || other.threads < base->threads))
+					base = &other;
+			}
+			if (base == nullptr || base == &result || base->threads == result.threads) continue;
+			result.scaling_efficiency = (base->render_seconds * base->threads) / (result.render_seconds * result.threads);
+		}
+	}
+
+	double per_second(double count, double seconds) {
+		return seconds > 0.0 ? count / seconds : 0.0;
+	}
+
+	void write_csv(std::ostream& out, const std::vector<benchmark_result>& results) {
+		out << "scene,writer,threads,tile,width,height,samples,rays,scene_s,bvh_s,render_s,export_s,wall_s,"
+			"rays_per_s,samples_per_s,scaling_efficiency,tile_max_s,tile_p95_s,utilization\n";
+		for (const auto& r : results) {
+			out << r.scene << ',' << r.writer << ',' << r.threads << ',' << r.tile << ',' << r.width << ',' << r.height << ','
+				<< r.samples << ',' << r.rays << ',' << r.scene_seconds << ',' << r.bvh_seconds << ','
+				<< r.render_seconds << ',' << r.export_seconds << ',' << r.wall_seconds << ','
+				<< per_second(static_cast<double>(r.rays), r.render_seconds) << ','
+				<< per_second(static_cast<double>(r.samples), r.render_seconds) << ',';
+			if (r.scaling_efficiency >= 0.0) out << r.scaling_efficiency;
+			out << ',';
+			if (r.utilization >= 0.0) out << r.tile_max_seconds << ',' << r.tile_p95_seconds << ',' << r.utilization;
+			else out << ",,";
+			out << '\n';
+		}
+	}
+
+	void write_json(std::ostream& out, const benchmark_options& options, const std::vector<benchmark_result>& results) {
+		out << "{\n  \"machine\": { \"hardware_threads\": " << std::thread::hardware_concurrency()
+			<< ", \"precision\": \"" << (sizeof(real) == sizeof(float) ? "float" : "double")
+			<< "\", \"sphere_soup_lanes\": " << sphere_soup::lane_width << " },\n"
+			<< "  \"settings\": { \"width\": " << options.width << ", \"spp\": " << options.samples
+			<< ", \"max_depth\": " << options.max_depth << ", \"packet_size\": " << options.packet_size
+			<< ", \"repeat\": " << options.repeats << ", \"seed\": " << options.seed << " },\n"
+			<< "  \"results\": [\n";
+		for (size_t i = 0; i < results.size(); ++i) {
+			const auto& r = results[i];
+			out << "    { \"scene\": \"" << r.scene << "\", \"writer\": \"" << r.writer << "\", \"threads\": " << r.threads
+				<< ", \"tile\": " << r.tile << ", \"width\": " << r.width << ", \"height\": " << r.height
+				<< ", \"samples\": " << r.samples << ", \"rays\": " << r.rays
+				<< ", \"phases\": { \"scene_s\": " << r.scene_seconds << ", \"bvh_s\": " << r.bvh_seconds
+				<< ", \"render_s\": " << r.render_seconds << ", \"export_s\": " << r.export_seconds << " }"
+				<< ", \"wall_s\": " << r.wall_seconds
+				<< ", \"rays_per_s\": " << per_second(static_cast<double>(r.rays), r.render_seconds)
+				<< ", \"samples_per_s\": " << per_second(static_cast<double>(r.samples), r.render_seconds)
+				<< ", \"scaling_efficiency\": ";
+			if (r.scaling_efficiency >= 0.0) out << r.scaling_efficiency;
+			else out << "null";
+			out << ", \"tiles\": ";
+			if (r.utilization >= 0.0) out << "{ \"max_s\": " << r.tile_max_seconds << ", \"p95_s\": " << r.tile_p95_seconds
+				<< ", \"utilization\": " << r.utilization << " }";
+			else out << "null";
+			out << " }" << (i + 1 < results.size() ? "," : "") << "\n";
+		}
+		out << "  ]\n}\n";
+	}
+
+	bool write_report(const std::string& path, const std::vector<benchmark_result>& results,
+		const benchmark_options& options, bool json) {
+		if (path == "-") {
+			if (json) write_json(std::cout, options, results);
+			else write_csv(std::cout, results);
+			return true;
+		}
+		std::ofstream out(path);
+		if (!out) {
+			std::cerr << "Could not open " << path << " for writing.\n";
+			return false;
+		}
+		if (json) write_json(out, options, results);
+		else write_csv(out, results);
+		return static_cast<bool>(out);
+	}
+}
+
+int RunRenderBenchmark(int argc, char* argv[])
+{
+	benchmark_options options;
+	if (!parse_options(argc, argv, options)) return 2;
+
+	const auto aspect_ratio = 3.0 / 2.0;
+	const int height = static_cast<int>(options.width / aspect_ratio);
+	const int max_threads = *std::max_element(options.threads.begin(), options.threads.end());
+	// The PNG writer needs a file; a name of its own keeps it off the user's.
+	std::error_code error;
+	std::filesystem::path temporary = std::filesystem::temp_directory_path(error);
+	if (error) temporary = ".";
+	const std::string png_path = (temporary / ("render_benchmark_"
+		+ std::to_string(bench_clock::now().time_since_epoch().count()) + ".png")).string();
+	null_buffer discard;
+	std::ostream ppm_out(&discard);
+	bool all_ran = true;
+	camera cam(point3(13, 2, 3), point3(0, 0, 0), vec3(0, 1, 0), 20, aspect_ratio, 0.6, 10.0);
+
+	std::vector<benchmark_result> results;
+	for (const auto& name : options.scenes) {
+		const scene_case* scene = nullptr;
+		for (const auto& candidate : scene_cases)
+			if (name == candidate.name) scene = &candidate;
+		if (scene == nullptr) {
+			std::cerr << "Unknown scene " << name << "\n";
+			return 2;
+		}
+
+		// Scenes draw from rand(), so the seed pins their layout.
+		std::srand(options.seed);
+		auto scene_start = bench_clock::now();
+		hittable_list list = scene->build();
+		double scene_seconds = seconds_since(scene_start);
+		auto bvh_start = bench_clock::now();
+		bvh_node world(list, sphere_soup::lane_width);
+		double bvh_seconds = seconds_since(bvh_start);
+
+		auto record = [&](std::optional<benchmark_result> run, const char* writer, int threads, int tile) {
+			if (!run) {
+				std::cerr << scene->name << " " << writer << " threads " << threads << " tile " << tile << ": failed, not recorded\n";
+				all_ran = false;
+				return;
+			}
+			benchmark_result result = *run;
+			result.scene = scene->name;
+			result.writer = writer;
+			result.threads = threads;
+			result.tile = tile;
+			result.scene_seconds = scene_seconds;
+			result.bvh_seconds = bvh_seconds;
+			std::cerr << scene->name << " " << writer << " threads " << threads << " tile " << tile << ": "
+				<< result.wall_seconds << " s, " << per_second(static_cast<double>(result.rays), result.render_seconds) / 1e6
+				<< " Mrays/s, " << per_second(static_cast<double>(result.samples), result.render_seconds) / 1e3 << " ksamples/s\n";
+			results.push_back(result);
+		};
+
+		record(run_writer(options, world, cam, height, [&](camera* c, hittable* w) {
+			auto writer = std::make_unique<PPMNonThreadedWriter>(c, w, options.width, height, options.samples, options.max_depth);
+			writer->SetOutput(ppm_out);
+			return writer;
+		}), "ppm-single", 1, -1);
+
+		for (int tile : options.tiles) {
+			int tile_width = tile > 0 ? tile : options.width;
+			int tile_height = tile > 0 ? tile : 1;
+			for (int threads : options.threads) {
+				record(run_writer(options, world, cam, height, [&](camera* c, hittable* w) {
+					auto writer = std::make_unique<PPMThreadedWriter>(c, w, options.width, height, options.samples, options.max_depth,
+						threads, tile_width, tile_height);
+					writer->SetOutput(ppm_out);
+					return writer;
+				}), "ppm-tiles", threads, tile);
+			}
+		}
+
+		// Tile schedules at the largest thread count, to compare against the plain ppm-tiles run at tile 16.
+		const struct { const char* name; TileOrder order; TileCostSource costs; } schedules[] = {
+			{ "ppm-tiles-hilbert", TileOrder::Hilbert, TileCostSource::None },
+			{ "ppm-tiles-spiral", TileOrder::Spiral, TileCostSource::None },
+			{ "ppm-tiles-costed", TileOrder::CostDescending, TileCostSource::PrePass },
+		};
+		for (const auto& schedule : schedules) {
+			record(run_writer(options, world, cam, height, [&](camera* c, hittable* w) {
+				auto writer = std::make_unique<PPMThreadedWriter>(c, w, options.width, height, options.samples, options.max_depth,
+					max_threads, 16, 16);
+				TileSchedule settings;
+				settings.order = schedule.order;
+				settings.costSource = schedule.costs;
+				writer->SetTileSchedule(settings);
+				writer->SetOutput(ppm_out);
+				return writer;
+			}), schedule.name, max_threads, 16);
+		}
+
+		record(run_writer(options, world, cam, height, [&](camera* c, hittable* w) {
+			auto writer = std::make_unique<PPMThreadedWriter>(c, w, options.width, height, options.samples, options.max_depth,
+				max_threads, 16, 16);
+			writer->SetWavefront(4096);
+			writer->SetOutput(ppm_out);
+			return writer;
+		}), "ppm-wavefront", max_threads, 16);
+
+		record(run_writer(options, world, cam, height, [&](camera* c, hittable* w) {
+			return std::make_unique<PNGThreadedWriter>(png_path, c, w, options.width, height, options.samples, options.max_depth,
+				max_threads, 16, 16);
+		}), "png-tiles", max_threads, 16);
+
+		// Progressive runs stop on noise, so their sample counts differ from the fixed runs.
+		record(run_writer(options, world, cam, height, [&](camera* c, hittable* w) {
+			auto writer = std::make_unique<PPMThreadedWriter>(c, w, options.width, height, options.samples, options.max_depth,
+				max_threads, 16, 16);
+			ProgressiveSettings settings;
+			settings.minSamples = std::max(2, options.samples / 2);
+			settings.maxSamples = options.samples * 4;
+			writer->SetOutput(ppm_out);
+			if (!writer->SetProgressive(settings)) writer.reset();
+			return writer;
+		}), "ppm-progressive", max_threads, 16);
+	}
+	std::remove(png_path.c_str());
+
+	compute_scaling(results);
+
+	bool written = true;
+	if (!options.csv_path.empty()) written = write_report(options.csv_path, results, options, false) && written;
+	if (!options.json_path.empty()) written = write_report(options.json_path, results, options, true) && written;
+	if (options.csv_path.empty() && options.json_path.empty()) write_csv(std::cout, results);
+	return written && all_ran ? 0 : 1;
+}
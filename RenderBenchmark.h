@@ -0,0 +1,22 @@
+#pragma once
+
+// Renders fixed-seed versions of book_scene(), random_scene() and
+// random_stacked_balls() with each writer type over a range of thread counts
+// and tile sizes, and reports wall time, per-phase timings, rays/sec,
+// samples/sec, tile timings and thread scaling efficiency. The tile order and
+// cost-estimate schedules run once each at the largest thread count.
+//
+// args are the command line arguments after --bench-render:
+//   --width N        image width (default 200, 3:2 aspect)
+//   --spp N          samples per pixel (default 16)
+//   --depth N        maximum bounces (default 50)
+//   --threads a,b,c  thread counts (default 1, 2, 4, ... up to the core count)
+//   --tiles a,b,c    square tile sizes, 0 meaning whole rows (default 8,16,32,64,0)
+//   --repeat N       runs per configuration, the fastest is kept (default 1)
+//   --seed N         scene seed (default 1)
+//   --scenes a,b     subset of book,random,stacked (default) and instanced
+//   --json FILE      write results as JSON
+//   --csv FILE       write results as CSV ("-" for stdout)
+// Runs that fail are reported and left out of the results. Returns the
+// process exit code, 1 if a run failed or a report could not be written.
+int RunRenderBenchmark(int argc, char* argv[]);
@@ -0,0 +1,223 @@
+#include "RenderCheckpoint.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace {
+	const char checkpointMagic[4] = { 'R', 'T', 'C', 'P' };
+	const uint32_t checkpointVersion = 1;
+
+	// Fields are written one by one in host byte order, without padding.
+	class Writer {
+	public:
+		explicit Writer(std::ofstream& out) : out(out) {}
+		template <typename T>
+		void Put(const T& value) { out.write(reinterpret_cast<const char*>(&value), sizeof(value)); }
+	private:
+		std::ofstream& out;
+	};
+
+	class Reader {
+	public:
+		explicit Reader(std::ifstream& in) : in(in) {}
+		template <typename T>
+		bool Get(T& value) { return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(value))); }
+	private:
+		std::ifstream& in;
+	};
+}
+
+bool SaveCheckpoint(const std::string& path, const RenderCheckpoint& checkpoint, std::string& error)
+{
+	const std::string temporary = path + ".tmp";
+	{
+		std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+		if (!out) {
+			error = "cannot write " + temporary;
+			return false;
+		}
+		Writer w(out);
+		out.write(checkpointMagic, sizeof(checkpointMagic));
+		w.Put(checkpointVersion);
+		w.Put(static_cast<uint32_t>(sizeof(real)));
+		w.Put(checkpoint.fingerprint);
+		w.Put(static_cast<int32_t>(checkpoint.width));
+		w.Put(static_cast<int32_t>(checkpoint.height));
+		w.Put(static_cast<uint8_t>(checkpoint.progressive));
+		w.Put(static_cast<int32_t>(checkpoint.passes));
+		w.Put(checkpoint.elapsedSeconds);
+
+		w.Put(static_cast<uint32_t>(checkpoint.tiles.size()));
+		for (const RenderCheckpoint::Tile& tile : checkpoint.tiles) {
+			w.Put(tile.x);
+			w.Put(tile.y);
+			w.Put(tile.width);
+			w.Put(tile.height);
+			w.Put(tile.parent);
+			w.Put(tile.samples);
+			w.Put(tile.active);
+			w.Put(tile.finished);
+			w.Put(tile.seconds);
+		}
+
+		w.Put(static_cast<uint64_t>(checkpoint.pixels.size()));
+		for (const pixel_estimate& pixel : checkpoint.pixels) {
+			w.Put(pixel.sum.x());
+			w.Put(pixel.sum.y());
+			w.Put(pixel.sum.z());
+			if (checkpoint.progressive) {
+				w.Put(pixel.luminance_sum);
+				w.Put(pixel.luminance_sum_sq);
+				w.Put(static_cast<int32_t>(pixel.samples));
+			}
+		}
+		out.flush();
+		if (!out) {
+			error = "cannot write " + temporary;
+			return false;
+		}
+	}
+
+#ifdef _WIN32
+	// rename does not replace an existing file on Windows.
+	std::remove(path.c_str());
+#endif
+	if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+		error = "cannot rename " + temporary + " to " + path;
+		return false;
+	}
+	return true;
+}
+
+bool LoadCheckpoint(const std::string& path, RenderCheckpoint& checkpoint, std::string& error)
+{
+	std::ifstream in(path, std::ios::binary);
+	if (!in) {
+		error = "cannot open " + path;
+		return false;
+	}
+	Reader r(in);
+	char magic[sizeof(checkpointMagic)];
+	uint32_t version = 0;
+	uint32_t realSize = 0;
+	if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, checkpointMagic, sizeof(magic)) != 0
+		|| !r.Get(version) || version != checkpointVersion) {
+		error = path + " is not a checkpoint of this renderer version";
+		return false;
+	}
+	if (!r.Get(realSize) || realSize != sizeof(real)) {
+		error = path + " was written by a build of another precision";
+		return false;
+	}
+
+	RenderCheckpoint loaded;
+	int32_t width = 0;
+	int32_t height = 0;
+	uint8_t progressive = 0;
+	int32_t passes = 0;
+	uint32_t tileCount = 0;
+	bool ok = r.Get(loaded.fingerprint) && r.Get(width) && r.Get(height) && r.Get(progressive)
+		&& r.Get(passes) && r.Get(loaded.elapsedSeconds) && r.Get(tileCount);
+	ok = ok && width > 0 && height > 0 && tileCount <= static_cast<uint64_t>(width) * height;
+	loaded.width = width;
+	loaded.height = height;
+	loaded.progressive = progressive != 0;
+	loaded.passes = passes;
+
+	// Pixels the tiles account for, to check the pixel block against.
+	uint64_t finishedPixels = 0;
+	if (ok) loaded.tiles.resize(tileCount);
+	for (uint32_t t = 0; ok && t < tileCount; ++t) {
+		RenderCheckpoint::Tile& tile = loaded.tiles[t];
+		ok = r.Get(tile.x) && r.Get(tile.y) && r.Get(tile.width) && r.Get(tile.height) && r.Get(tile.parent)
+			&& r.Get(tile.samples) && r.Get(tile.active) && r.Get(tile.finished) && r.Get(tile.seconds);
+		// Every base tile has at least one tile of its own, so parents index
+		// fewer tiles than there are.
+		ok = ok && tile.x >= 0 && tile.y >= 0 && tile.width > 0 && tile.height > 0
+			&& tile.x + tile.width <= width && tile.y + tile.height <= height
+			&& tile.parent >= 0 && static_cast<uint32_t>(tile.parent) < tileCount;
+		if (ok && tile.finished) finishedPixels += static_cast<uint64_t>(tile.width) * tile.height;
+	}
+
+	uint64_t pixelCount = 0;
+	ok = ok && r.Get(pixelCount);
+	const uint64_t expected = loaded.progressive ? static_cast<uint64_t>(width) * height : finishedPixels;
+	ok = ok && pixelCount == expected;
+	if (ok) loaded.pixels.resize(pixelCount);
+	for (uint64_t i = 0; ok && i < pixelCount; ++i) {
+		pixel_estimate& pixel = loaded.pixels[i];
+		real rgb[3];
+		ok = r.Get(rgb[0]) && r.Get(rgb[1]) && r.Get(rgb[2]);
+		pixel.sum = color(rgb[0], rgb[1], rgb[2]);
+		if (ok && loaded.progressive) {
+			int32_t samples = 0;
+			ok = r.Get(pixel.luminance_sum) && r.Get(pixel.luminance_sum_sq) && r.Get(samples);
+			pixel.samples = samples;
+		}
+	}
+	if (!ok) {
+		error = path + " is truncated or corrupt";
+		return false;
+	}
+	checkpoint = std::move(loaded);
+	return true;
+}
+
+CheckpointWriter::CheckpointWriter(std::string path) :
+	path(std::move(path)),
+	thread(&CheckpointWriter::Loop, this)
+{
+}
+
+CheckpointWriter::~CheckpointWriter()
+{
+	// Whatever is queued still gets written.
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		stopping = true;
+	}
+	changed.notify_all();
+	thread.join();
+}
+
+void CheckpointWriter::Submit(RenderCheckpoint&& checkpoint)
+{
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		queued = std::make_unique<RenderCheckpoint>(std::move(checkpoint));
+	}
+	changed.notify_all();
+}
+
+bool CheckpointWriter::IsBusy()
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	return queued || writing;
+}
+
+void CheckpointWriter::Flush()
+{
+	std::unique_lock<std::mutex> lock(mtx);
+	changed.wait(lock, [this] { return !queued && !writing; });
+}
+
+void CheckpointWriter::Loop()
+{
+	std::unique_lock<std::mutex> lock(mtx);
+	while (true) {
+		changed.wait(lock, [this] { return queued || stopping; });
+		if (!queued) return;
+
+		std::unique_ptr<RenderCheckpoint> checkpoint = std::move(queued);
+		writing = true;
+		lock.unlock();
+		std::string error;
+		if (!SaveCheckpoint(path, *checkpoint, error)) std::cerr << "\nCheckpoint failed: " << error << "\n";
+		checkpoint.reset();
+		lock.lock();
+		writing = false;
+		changed.notify_all();
+	}
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "rtweekend.h"
+
+#include "film.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// What ThreadedImageWriter needs to continue an interrupted Run() and still
+// produce the image an uninterrupted one would. Samples come from a
+// counter-based sampler keyed by pixel and sample index, so how many
+// samples a pixel has is all the random state there is to save.
+struct RenderCheckpoint {
+	struct Tile {
+		int32_t x = 0;
+		int32_t y = 0;
+		int32_t width = 0;
+		int32_t height = 0;
+		int32_t parent = 0;
+		int32_t samples = 0;
+		// Progressive renders: still refining. Fixed renders: all samples done.
+		uint8_t active = 0;
+		uint8_t finished = 0;
+		double seconds = 0.0;
+	};
+
+	// Identifies the job; a checkpoint is only resumed by the same one.
+	uint64_t fingerprint = 0;
+	int width = 0;
+	int height = 0;
+	bool progressive = false;
+	// Passes of a progressive render completed so far.
+	int passes = 0;
+	// Render time over every run so far.
+	double elapsedSeconds = 0.0;
+	std::vector<Tile> tiles;
+	// Progressive renders: every pixel of the image, row by row from the
+	// bottom, as film::row_major() lists them.
+	// Fixed renders: the pixels of the finished tiles, tile by tile and row
+	// by row, with only their sums kept.
+	std::vector<pixel_estimate> pixels;
+};
+
+// The file is written next to path and renamed over it, so a crash while
+// saving leaves the previous checkpoint intact.
+bool SaveCheckpoint(const std::string& path, const RenderCheckpoint& checkpoint, std::string& error);
+bool LoadCheckpoint(const std::string& path, RenderCheckpoint& checkpoint, std::string& error);
+
+// Saves checkpoints on a thread of its own, so neither the tiles nor the
+// thread waiting for them stall on the disk.
+class CheckpointWriter
+{
+public:
+	explicit CheckpointWriter(std::string path);
+	~CheckpointWriter();
+	CheckpointWriter(const CheckpointWriter&) = delete;
+	CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+
+	// Queues the checkpoint, replacing one still waiting to be written.
+	void Submit(RenderCheckpoint&& checkpoint);
+	// True while a checkpoint is queued or being written. Callers skip taking
+	// a new snapshot then rather than pile them up.
+	bool IsBusy();
+	// Waits until every submitted checkpoint is on disk.
+	void Flush();
+
+	const std::string& GetPath() const { return path; }
+
+private:
+	void Loop();
+
+	std::string path;
+	std::mutex mtx;
+	std::condition_variable changed;
+	std::unique_ptr<RenderCheckpoint> queued;
+	bool writing = false;
+	bool stopping = false;
+	std::thread thread;
+};
@@ -0,0 +1,233 @@
+#include "RenderOptions.h"
+
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+namespace {
+	// Largest image, and most samples over the whole image, a render may ask
+	// for. Past these the film and framebuffer alone take gigabytes.
+	const long long maxPixels = 1LL << 27;
+	const long long maxImageSamples = 1LL << 40;
+
+	bool ParseInt(const char* text, int minimum, int& out) {
+		char* end = nullptr;
+		errno = 0;
+		long value = std::strtol(text, &end, 10);
+		if (end == text || *end != '\0' || errno == ERANGE || value < minimum || value > INT_MAX) return false;
+		out = static_cast<int>(value);
+		return true;
+	}
+
+	bool ParseDouble(const char* text, double minimum, double& out) {
+		char* end = nullptr;
+		errno = 0;
+		double value = std::strtod(text, &end);
+		if (end == text || *end != '\0' || errno == ERANGE || !std::isfinite(value) || value < minimum) return false;
+		out = value;
+		return true;
+	}
+
+	// "x,y,z"
+	bool ParsePoint(const char* text, point3& out) {
+		double v[3];
+		const char* p = text;
+		for (int i = 0; i < 3; ++i) {
+			char* end = nullptr;
+			v[i] = std::strtod(p, &end);
+			if (end == p) return false;
+			p = end;
+			if (i < 2) {
+				if (*p != ',') return false;
+				++p;
+			}
+		}
+		if (*p != '\0') return false;
+		out = point3(static_cast<real>(v[0]), static_cast<real>(v[1]), static_cast<real>(v[2]));
+		return true;
+	}
+
+	bool EndsWith(const std::string& text, const std::string& suffix) {
+		return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+	}
+}
+
+bool RenderOptions::WritesPNG() const {
+	return EndsWith(output, ".png") || EndsWith(output, ".PNG");
+}
+
+bool RenderOptions::WritesHDR() const {
+	return EndsWith(output, ".pfm") || EndsWith(output, ".PFM") || EndsWith(output, ".exr") || EndsWith(output, ".EXR");
+}
+
+bool ParseRenderOptions(int argc, char* argv[], RenderOptions& options, std::string& error)
+{
+	for (int i = 0; i < argc; ++i) {
+		std::string arg = argv[i];
+
+		// Flags without a value.
+		if (arg == "--help" || arg == "-h") { options.help = true; continue; }
+		if (arg == "--single-threaded") { options.singleThreaded = true; continue; }
+		if (arg == "--progressive") { options.progressive = true; continue; }
+		if (arg == "--no-roulette") { options.russianRoulette = false; continue; }
+		if (arg == "--quiet") { options.quiet = true; continue; }
+		if (arg == "--resume") { options.resume = true; continue; }
+
+		if (i + 1 >= argc) {
+			error = "missing value for " + arg;
+			return false;
+		}
+		const char* value = argv[++i];
+		double number = 0.0;
+		point3 point;
+		bool ok = true;
+
+		if (arg == "--width") ok = ParseInt(value, 2, options.width);
+		else if (arg == "--height") ok = ParseInt(value, 2, options.height);
+		else if (arg == "--aspect") ok = ParseDouble(value, 0.0, options.aspect) && options.aspect > 0.0;
+		else if (arg == "--spp") ok = ParseInt(value, 1, options.samples);
+		else if (arg == "--depth") ok = ParseInt(value, 1, options.maxDepth);
+		else if (arg == "--min-bounces") ok = ParseInt(value, 0, options.minBounces);
+		else if (arg == "--scene") options.scene = value;
+		else if (arg == "--seed") {
+			int seed = 0;
+			ok = ParseInt(value, 0, seed);
+			options.seed = static_cast<unsigned int>(seed);
+		}
+		else if (arg == "--output" || arg == "-o") options.output = value;
+		else if (arg == "--exposure") ok = ParseDouble(value, -100.0, options.exposure) && options.exposure <= 100.0;
+		else if (arg == "--export-scene") options.exportScene = value;
+		else if (arg == "--threads") ok = ParseInt(value, 1, options.threads);
+		else if (arg == "--tile") ok = ParseInt(value, 0, options.tileSize);
+		else if (arg == "--packet") ok = ParseInt(value, 0, options.packetSize);
+		else if (arg == "--tile-order") {
+			std::string order = value;
+			if (order == "rows") options.tileSchedule.order = TileOrder::Rows;
+			else if (order == "hilbert") options.tileSchedule.order = TileOrder::Hilbert;
+			else if (order == "spiral") options.tileSchedule.order = TileOrder::Spiral;
+			else if (order == "cost") options.tileSchedule.order = TileOrder::CostDescending;
+			else ok = false;
+		}
+		else if (arg == "--tile-costs") {
+			std::string source = value;
+			if (source == "none") options.tileSchedule.costSource = TileCostSource::None;
+			else if (source == "prepass") options.tileSchedule.costSource = TileCostSource::PrePass;
+			else ok = false;
+		}
+		else if (arg == "--wavefront") ok = ParseInt(value, 0, options.wavefront);
+		else if (arg == "--min-tile") ok = ParseInt(value, 1, options.tileSchedule.minTileSize);
+		else if (arg == "--timeout") ok = ParseDouble(value, 0.0, options.timeout);
+		else if (arg == "--stats") options.statsFile = value;
+		else if (arg == "--trace") options.traceFile = value;
+		else if (arg == "--workers") ok = ParseInt(value, 0, options.workers);
+		else if (arg == "--listen") ok = ParseInt(value, 1, options.listenPort) && options.listenPort <= 65535;
+		else if (arg == "--worker") options.workerOf = value;
+		else if (arg == "--checkpoint") options.checkpointFile = value;
+		else if (arg == "--checkpoint-interval") ok = ParseDouble(value, 0.0, options.checkpointInterval) && options.checkpointInterval > 0.0;
+		else if (arg == "--noise") ok = ParseDouble(value, 0.0, options.noiseThreshold);
+		else if (arg == "--max-spp") ok = ParseInt(value, 1, options.maxSamples);
+		else if (arg == "--time-budget") ok = ParseDouble(value, 0.0, options.timeBudget);
+		else if (arg == "--lookfrom") { ok = ParsePoint(value, point); options.lookfrom = point; }
+		else if (arg == "--lookat") { ok = ParsePoint(value, point); options.lookat = point; }
+		else if (arg == "--vfov") {
+			ok = ParseDouble(value, 0.0, number) && number > 0.0 && number < 180.0;
+			options.vfov = static_cast<real>(number);
+		}
+		else if (arg == "--aperture") { ok = ParseDouble(value, 0.0, number); options.aperture = static_cast<real>(number); }
+		else if (arg == "--focus") { ok = ParseDouble(value, 0.0, number) && number > 0.0; options.focusDist = static_cast<real>(number); }
+		else {
+			error = "unknown option " + arg;
+			return false;
+		}
+		if (!ok) {
+			error = "bad value for " + arg + ": " + value;
+			return false;
+		}
+	}
+	// A height derived from a tiny aspect ratio would not fit in an int.
+	if (options.height == 0 && options.width / options.aspect > static_cast<double>(maxPixels)) {
+		error = "the image is too large: at most " + std::to_string(maxPixels) + " pixels";
+		return false;
+	}
+	// The camera maps pixels to [0,1] by dividing by width - 1 and height - 1.
+	if (options.ImageHeight() < 2) {
+		error = "the image must be at least 2 pixels high; raise --width or set --height";
+		return false;
+	}
+	const long long pixels = static_cast<long long>(options.width) * options.ImageHeight();
+	const int samples = options.progressive ? options.maxSamples : options.samples;
+	if (pixels > maxPixels || pixels * samples > maxImageSamples) {
+		error = "the image is too large: at most " + std::to_string(maxPixels) + " pixels and "
+			+ std::to_string(maxImageSamples) + " samples in all";
+		return false;
+	}
+	return true;
+}
+
+void PrintRenderUsage(const char* program)
+{
+	std::cerr <<
+		"Usage: " << program << " [options]\n"
+		"\n"
+		"Scene\n"
+		"  --scene NAME|FILE      book, random, stacked, instanced or a scene file (default random)\n"
+		"  --seed N               rand() seed for the builtin scenes (default 1)\n"
+		"  --export-scene FILE    write the scene as a scene file and exit\n"
+		"  --lookfrom X,Y,Z       camera position\n"
+		"  --lookat X,Y,Z         camera target\n"
+		"  --vfov DEGREES         vertical field of view, between 0 and 180\n"
+		"  --aperture A           lens aperture, 0 for a pinhole\n"
+		"  --focus D              focus distance, above 0\n"
+		"\n"
+		"Image\n"
+		"  --width N              image width, at least 2 (default 1200)\n"
+		"  --height N             image height, at least 2 (default width / aspect)\n"
+		"  --aspect R             aspect ratio (default 1.5)\n"
+		"  --spp N                samples per pixel (default 60)\n"
+		"  --depth N              maximum bounces (default 50)\n"
+		"  --min-bounces N        bounces before Russian roulette starts (default 3)\n"
+		"  --no-roulette          trace every path to --depth\n"
+		"  -o, --output FILE      .png or .ppm, linear .pfm or .exr, '-' for PPM on stdout\n"
+		"                         (default render.png)\n"
+		"  --exposure STOPS       brighten or darken .png and .ppm output (default 0)\n"
+		"\n"
+		"Execution\n"
+		"  --single-threaded      render on the calling thread\n"
+		"  --threads N            worker threads (default 8)\n"
+		"  --tile N               square tile size, 0 for whole rows (default 20)\n"
+		"  --packet N             ray packet width, 0 or 1 to disable (default 8)\n"
+		"  --wavefront N          trace tiles breadth-first in waves of about N paths\n"
+		"  --tile-order ORDER     rows, hilbert, spiral or cost (default rows)\n"
+		"  --tile-costs SOURCE    none, or prepass to time probes and split costly tiles\n"
+		"  --min-tile N           smallest side a costly tile is split down to (default 4)\n"
+		"  --timeout SECONDS      cancel an unfinished threaded render\n"
+		"  --quiet                no progress output\n"
+		"  --stats FILE           write timings and ray counters as JSON\n"
+		"  --trace FILE           write the tile tasks as a Chrome trace (threaded only)\n"
+		"\n"
+		"Checkpoints (threaded only)\n"
+		"  --checkpoint FILE      save the render state to FILE while rendering and on timeout\n"
+		"  --checkpoint-interval SECONDS\n"
+		"                         time between checkpoints (default 60)\n"
+		"  --resume               continue from --checkpoint FILE if it exists; the image\n"
+		"                         matches an uninterrupted render\n"
+		"\n"
+		"Distributed rendering (threaded only)\n"
+		"  --workers N            render tiles in N worker processes on this machine\n"
+		"  --listen PORT          also accept workers from other machines on PORT\n"
+		"  --worker HOST:PORT     render tiles for the coordinator at HOST:PORT, started\n"
+		"                         with the same scene and image options\n"
+		"\n"
+		"Progressive rendering (threaded only, replaces --spp)\n"
+		"  --progressive          refine tiles until their noise is below --noise\n"
+		"  --noise E              displayed standard error threshold (default 0.005)\n"
+		"  --max-spp N            sample cap per pixel (default 1024)\n"
+		"  --time-budget SECONDS  start no new pass after this long\n"
+		"\n"
+		"Other modes\n"
+		"  --bench-bvh | --bench-integrator | --bench-hit-scaling\n"
+		"  --bench-render [options] | --bench-mesh FILE.obj\n"
+		"  --precision-reference FILE | --precision-check FILE [min_psnr]\n";
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "scene_file.h"
+#include "ImageWriters.h"
+
+#include <optional>
+#include <string>
+
+// Everything the renderer's command line can set. The defaults reproduce the
+// render main() used to hardcode.
+struct RenderOptions {
+	int width = 1200;
+	// Zero derives the height from width and aspect.
+	int height = 0;
+	double aspect = 3.0 / 2.0;
+	int samples = 60;
+	int maxDepth = 50;
+	int minBounces = 3;
+	bool russianRoulette = true;
+
+	// book, random, stacked, instanced or the path of a scene file (see scene_file.h).
+	std::string scene = "random";
+	// Seeds rand() before a builtin scene is generated.
+	unsigned int seed = 1;
+	// .png, .ppm, or linear .pfm or .exr; "-" writes PPM to stdout.
+	std::string output = "render.png";
+	// Stops of exposure applied when tone mapping to 8 bits.
+	double exposure = 0.0;
+	// Writes the scene to this file and exits without rendering.
+	std::string exportScene;
+
+	bool singleThreaded = false;
+	int threads = 8;
+	int tileSize = 20;
+	int packetSize = 8;
+	TileSchedule tileSchedule;
+	// Paths per wave for the wavefront integrator, zero for depth-first.
+	int wavefront = 0;
+	// Seconds before an unfinished render is cancelled. Zero waits forever.
+	double timeout = 0.0;
+	bool quiet = false;
+	// JSON timings and counters, and a Chrome trace of the tile tasks.
+	// Counters are only gathered in builds with RT_STATS.
+	std::string statsFile;
+	std::string traceFile;
+
+	// Distributed rendering (see TileProtocol.h): spawn this many local worker
+	// processes, and/or accept workers from other machines on listenPort.
+	// Without a listen port the coordinator only takes local connections.
+	int workers = 0;
+	int listenPort = 0;
+	// host:port of a coordinator; renders its tiles instead of an image.
+	std::string workerOf;
+
+	// Saves the render state to checkpointFile every checkpointInterval
+	// seconds; resume continues from it when it exists.
+	std::string checkpointFile;
+	double checkpointInterval = 60.0;
+	bool resume = false;
+
+	bool progressive = false;
+	double noiseThreshold = 0.005;
+	int maxSamples = 1024;
+	double timeBudget = 0.0;
+
+	// Override the scene file's camera, or the default one.
+	std::optional<point3> lookfrom;
+	std::optional<point3> lookat;
+	std::optional<real> vfov;
+	std::optional<real> aperture;
+	std::optional<real> focusDist;
+
+	bool help = false;
+
+	int ImageHeight() const {
+		return height > 0 ? height : static_cast<int>(width / aspect);
+	}
+	bool WritesPNG() const;
+	bool WritesHDR() const;
+};
+
+// Parses args (argv without the program name). Returns false and sets error
+// on an unknown option or a bad value.
+bool ParseRenderOptions(int argc, char* argv[], RenderOptions& options, std::string& error);
+void PrintRenderUsage(const char* program);
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <utility>
+
+// Storage for the tasks one frame hands to a ThreadPool. Create() reuses the
+// slots of earlier frames, so after the first frame scheduling allocates
+// nothing. A deque keeps every task at a fixed address as the pool grows.
+// The owner calls Reset() only once none of the tasks can still run, and
+// must outlive the ThreadPool the tasks were scheduled on.
+template <typename Task>
+class TaskPool
+{
+public:
+	template <typename... Args>
+	Task* Create(Args&&... args) {
+		if (used < tasks.size())
+			tasks[used] = Task(std::forward<Args>(args)...);
+		else
+			tasks.emplace_back(std::forward<Args>(args)...);
+		return &tasks[used++];
+	}
+	// Makes every slot available again without freeing them.
+	void Reset() { used = 0; }
+	size_t Size() const { return used; }
+	size_t Capacity() const { return tasks.size(); }
+
+private:
+	std::deque<Task> tasks;
+	size_t used = 0;
+};
@@ -1,68 +1,119 @@
 #include "ThreadPool.h"
 
-#include <iostream>
-#include <string>
+namespace {
+	// Lets ScheduleTask push onto the calling worker's own deque.
+	thread_local const ThreadPool* currentPool = nullptr;
+	thread_local int currentWorker = -1;
+}
 
 ThreadPool::ThreadPool(int workerCount)
 {
-	workerCount = workerCount;
+	this->workerCount = workerCount > 0 ? workerCount : 1;
 
-	for (int i = 0; i < workerCount; i++) {
-		InactiveThreads.push(new WorkerThread(i, this));
+	for (int i = 0; i < this->workerCount; i++) {
+		queues.push_back(std::make_unique<WorkQueue>());
+		workers.push_back(std::make_unique<WorkerThread>(i, this, this));
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	StopScheduling();
+	for (auto& worker : workers) {
+		worker->join();
 	}
 }
 
 void ThreadPool::StartScheduling()
 {
-	//std::string str = "Starting Thread Pool with " + std::to_string(workerCount) + " threads.\n";
-	//std::cerr << str;
+	if (this->isRunning) return;
 	this->isRunning = true;
-	this->start();
+	for (auto& worker : workers) {
+		worker->start();
+	}
 }
 
 void ThreadPool::StopScheduling()
 {
-	this->isRunning = false;
+	// Workers drain whatever is still queued, then exit.
+	{
+		std::lock_guard<std::mutex> lock(sleepMtx);
+		this->isStopping = true;
+	}
+	taskAvailable.notify_all();
 }
 
 void ThreadPool::ScheduleTask(IWorkerAction* task)
 {
-	this->PendingTasks.push(task);
-	//std::string str = "Scheduling Task: " + std::to_string(PendingTasks.size()) + " tasks.\n";
-	//std::cerr << str;
+	if (task == nullptr) return;
+
+	int target = (currentPool == this) ? currentWorker : static_cast<int>(nextQueue++ % workerCount);
+
+	unfinishedTasks++;
+	{
+		std::lock_guard<std::mutex> lock(queues[target]->mtx);
+		queues[target]->tasks.push_back(task);
+	}
+	queuedTasks++;
+
+	// Taking the lock orders this wake-up after a sleeper's predicate check.
+	{
+		std::lock_guard<std::mutex> lock(sleepMtx);
+	}
+	taskAvailable.notify_one();
 }
 
-void ThreadPool::run()
+void ThreadPool::WaitAll()
 {
-	while (this->isRunning) {
-		// Has task to do
-		if (!this->PendingTasks.empty()) {
-			// Has thread available
-			if (!this->InactiveThreads.empty()) {
-				// Take the queued inactive thread
-				auto workerThread = this->InactiveThreads.front();
-				this->InactiveThreads.pop();
-
-				// Assign id in unordered map
-				this->ActiveThreads[workerThread->GetID()] = workerThread;
-
-				// Grab and assign queued task
-				auto task = this->PendingTasks.front();
-				workerThread->AssignTask(task);
-				this->PendingTasks.pop();
-
-				workerThread->start();
-			}
+	std::unique_lock<std::mutex> lock(finishedMtx);
+	allFinished.wait(lock, [this] { return unfinishedTasks.load() == 0; });
+}
+
+bool ThreadPool::TryPop(int id, IWorkerAction*& task)
+{
+	WorkQueue& queue = *queues[id];
+	std::lock_guard<std::mutex> lock(queue.mtx);
+	if (queue.tasks.empty()) return false;
+	task = queue.tasks.back();
+	queue.tasks.pop_back();
+	return true;
+}
+
+bool ThreadPool::TrySteal(int id, IWorkerAction*& task)
+{
+	for (int offset = 1; offset < workerCount; offset++) {
+		WorkQueue& victim = *queues[(id + offset) % workerCount];
+		std::lock_guard<std::mutex> lock(victim.mtx);
+		if (victim.tasks.empty()) continue;
+		task = victim.tasks.front();
+		victim.tasks.pop_front();
+		return true;
+	}
+	return false;
+}
+
+IWorkerAction* ThreadPool::AcquireTask(int id)
+{
+	currentPool = this;
+	currentWorker = id;
+
+	while (true) {
+		IWorkerAction* task = nullptr;
+		if (TryPop(id, task) || TrySteal(id, task)) {
+			queuedTasks--;
+			return task;
 		}
+
+		std::unique_lock<std::mutex> lock(sleepMtx);
+		taskAvailable.wait(lock, [this] { return queuedTasks.load() > 0 || isStopping.load(); });
+		if (isStopping && queuedTasks.load() == 0) return nullptr;
 	}
 }
 
 void ThreadPool::OnFinishedTask(int id)
 {
-	if (this->ActiveThreads[id] != nullptr) {
-		delete this->ActiveThreads[id];
-		this->ActiveThreads.erase(id);
-
-		InactiveThreads.push(new WorkerThread(id, this));
+	if (--unfinishedTasks == 0) {
+		std::lock_guard<std::mutex> lock(finishedMtx);
+		allFinished.notify_all();
 	}
 }
@@ -1,32 +1,56 @@
 #pragma once
 
-#include <queue>
-#include <unordered_map>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 #include "WorkerThread.h"
 #include "IWorkerAction.h"
-#include "IThread.h"
 
-class ThreadPool : public IThread, public IFinishedTask
+// Fixed set of persistent workers, each owning a task deque. Workers pop
+// their own deque LIFO and steal from the others FIFO, and sleep on a
+// condition variable when every deque is empty.
+class ThreadPool : public ITaskSource, public IFinishedTask
 {
 public:
 	ThreadPool(int workerCount);
-	~ThreadPool() {}
+	~ThreadPool();
 
 	void StartScheduling();
 	void StopScheduling();
 	void ScheduleTask(IWorkerAction* task);
+	// Blocks until every scheduled task has finished. Must not be called from a worker.
+	void WaitAll();
+	int GetWorkerCount() const { return workerCount; }
 
 private:
+	struct WorkQueue {
+		std::mutex mtx;
+		std::deque<IWorkerAction*> tasks;
+	};
+
 	bool isRunning = false;
 	int workerCount = 1;
 
-	std::queue<IWorkerAction*> PendingTasks;
-	std::queue<WorkerThread*> InactiveThreads;
-	std::unordered_map<int, WorkerThread*> ActiveThreads;
+	std::vector<std::unique_ptr<WorkQueue>> queues;
+	std::vector<std::unique_ptr<WorkerThread>> workers;
+
+	std::atomic<int> queuedTasks{ 0 };
+	std::atomic<int> unfinishedTasks{ 0 };
+	std::atomic<unsigned int> nextQueue{ 0 };
+	std::atomic<bool> isStopping{ false };
+
+	std::mutex sleepMtx;
+	std::condition_variable taskAvailable;
+	std::mutex finishedMtx;
+	std::condition_variable allFinished;
 
 private:
-	void run() override;
-	void OnFinishedTask(int id);
+	bool TryPop(int id, IWorkerAction*& task);
+	bool TrySteal(int id, IWorkerAction*& task);
+	IWorkerAction* AcquireTask(int id) override;
+	void OnFinishedTask(int id) override;
 };
-
@@ -0,0 +1,457 @@
+#include "TileProtocol.h"
+
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace {
+	// Larger messages are treated as a broken peer rather than allocated.
+	const uint32_t maxMessageSize = 256u << 20;
+
+#ifdef _WIN32
+	void StartNetworking() {
+		static const bool started = [] {
+			WSADATA data;
+			return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+		}();
+		(void)started;
+	}
+	bool WouldBlock() { return WSAGetLastError() == WSAEWOULDBLOCK; }
+	void CloseHandleOf(uintptr_t handle) { closesocket(static_cast<SOCKET>(handle)); }
+	using PollEntry = WSAPOLLFD;
+	int PollSockets(PollEntry* entries, size_t count, int timeoutMs) { return WSAPoll(entries, static_cast<ULONG>(count), timeoutMs); }
+	const int sendFlags = 0;
+#else
+	void StartNetworking() {}
+	bool WouldBlock() { return errno == EAGAIN || errno == EWOULDBLOCK; }
+	void CloseHandleOf(int handle) { close(handle); }
+	using PollEntry = pollfd;
+	int PollSockets(PollEntry* entries, size_t count, int timeoutMs) { return poll(entries, static_cast<nfds_t>(count), timeoutMs); }
+	// A dead peer must not kill the process with SIGPIPE.
+#ifdef MSG_NOSIGNAL
+	const int sendFlags = MSG_NOSIGNAL;
+#else
+	const int sendFlags = 0;
+#endif
+#endif
+
+	// Tile requests are tiny; without this they would wait for Nagle's timer.
+	template <typename Handle>
+	void DisableNagle(Handle handle) {
+		int on = 1;
+		setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&on), sizeof(on));
+	}
+}
+
+Socket::Handle Socket::InvalidHandle()
+{
+#ifdef _WIN32
+	return static_cast<Handle>(INVALID_SOCKET);
+#else
+	return -1;
+#endif
+}
+
+Socket::~Socket()
+{
+	Close();
+}
+
+Socket::Socket(Socket&& other) noexcept : handle(other.handle)
+{
+	other.handle = InvalidHandle();
+}
+
+Socket& Socket::operator=(Socket&& other) noexcept
+{
+	if (this != &other) {
+		Close();
+		handle = other.handle;
+		other.handle = InvalidHandle();
+	}
+	return *this;
+}
+
+bool Socket::IsValid() const
+{
+	return handle != InvalidHandle();
+}
+
+void Socket::Close()
+{
+	if (IsValid()) CloseHandleOf(handle);
+	handle = InvalidHandle();
+}
+
+bool Socket::Listen(int port, bool localOnly, std::string& error)
+{
+	StartNetworking();
+	Close();
+	handle = static_cast<Handle>(socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+	if (!IsValid()) {
+		error = "cannot create a socket";
+		return false;
+	}
+	int on = 1;
+	setsockopt(handle, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&on), sizeof(on));
+
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_port = htons(static_cast<uint16_t>(port));
+	address.sin_addr.s_addr = htonl(localOnly ? INADDR_LOOPBACK : INADDR_ANY);
+	if (bind(handle, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || listen(handle, 64) != 0) {
+		error = "cannot listen on port " + std::to_string(port);
+		Close();
+		return false;
+	}
+	return true;
+}
+
+bool Socket::Connect(const std::string& host, int port, std::string& error)
+{
+	StartNetworking();
+	Close();
+	addrinfo hints = {};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	addrinfo* found = nullptr;
+	if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &found) != 0 || found == nullptr) {
+		error = "cannot resolve " + host;
+		return false;
+	}
+	for (addrinfo* a = found; a != nullptr; a = a->ai_next) {
+		handle = static_cast<Handle>(socket(a->ai_family, a->ai_socktype, a->ai_protocol));
+		if (!IsValid()) continue;
+		if (connect(handle, a->ai_addr, static_cast<int>(a->ai_addrlen)) == 0) break;
+		Close();
+	}
+	freeaddrinfo(found);
+	if (!IsValid()) {
+		error = "cannot connect to " + host + ":" + std::to_string(port);
+		return false;
+	}
+	DisableNagle(handle);
+	return true;
+}
+
+Socket Socket::Accept()
+{
+	Handle accepted = static_cast<Handle>(accept(handle, nullptr, nullptr));
+	if (accepted == InvalidHandle()) return Socket();
+	DisableNagle(accepted);
+	return Socket(accepted);
+}
+
+void Socket::SetNonBlocking()
+{
+#ifdef _WIN32
+	u_long on = 1;
+	ioctlsocket(static_cast<SOCKET>(handle), FIONBIO, &on);
+#else
+	fcntl(handle, F_SETFL, fcntl(handle, F_GETFL, 0) | O_NONBLOCK);
+#endif
+}
+
+int Socket::GetPort() const
+{
+	sockaddr_in address = {};
+	socklen_t length = sizeof(address);
+	if (!IsValid() || getsockname(handle, reinterpret_cast<sockaddr*>(&address), &length) != 0) return 0;
+	return ntohs(address.sin_port);
+}
+
+bool Socket::SendAll(const void* data, size_t size)
+{
+	const char* bytes = static_cast<const char*>(data);
+	while (size > 0) {
+		int chunk = static_cast<int>(std::min<size_t>(size, 1 << 30));
+		auto sent = send(handle, bytes, chunk, sendFlags);
+		if (sent < 0) {
+			if (!WouldBlock()) return false;
+			// A non-blocking socket with a full buffer: give the peer a few
+			// seconds to drain it before calling it dead.
+			PollEntry entry = {};
+			entry.fd = handle;
+			entry.events = POLLOUT;
+			if (PollSockets(&entry, 1, 5000) <= 0) return false;
+			continue;
+		}
+		bytes += sent;
+		size -= static_cast<size_t>(sent);
+	}
+	return true;
+}
+
+bool Socket::ReceiveAll(void* data, size_t size)
+{
+	char* bytes = static_cast<char*>(data);
+	while (size > 0) {
+		int chunk = static_cast<int>(std::min<size_t>(size, 1 << 30));
+		auto received = recv(handle, bytes, chunk, 0);
+		if (received <= 0) return false;
+		bytes += received;
+		size -= static_cast<size_t>(received);
+	}
+	return true;
+}
+
+long Socket::ReceiveSome(void* data, size_t size)
+{
+	int chunk = static_cast<int>(std::min<size_t>(size, 1 << 30));
+	auto received = recv(handle, static_cast<char*>(data), chunk, 0);
+	if (received > 0) return static_cast<long>(received);
+	if (received < 0 && WouldBlock()) return 0;
+	return -1;
+}
+
+void Socket::WaitReadable(const std::vector<const Socket*>& sockets, std::vector<bool>& ready, std::chrono::milliseconds timeout)
+{
+	std::vector<PollEntry> entries(sockets.size());
+	for (size_t i = 0; i < sockets.size(); ++i) {
+		entries[i].fd = sockets[i]->handle;
+		entries[i].events = POLLIN;
+	}
+	ready.assign(sockets.size(), false);
+	if (PollSockets(entries.data(), entries.size(), static_cast<int>(timeout.count())) <= 0) return;
+	for (size_t i = 0; i < sockets.size(); ++i)
+		ready[i] = (entries[i].revents & (POLLIN | POLLHUP | POLLERR)) != 0;
+}
+
+bool SendTileMessage(Socket& socket, MessageType type, const void* payload, uint32_t size)
+{
+	MessageHeader header{ type, size };
+	return socket.SendAll(&header, sizeof(header)) && (size == 0 || socket.SendAll(payload, size));
+}
+
+bool ReceiveTileMessage(Socket& socket, MessageType& type, std::vector<unsigned char>& payload)
+{
+	MessageHeader header;
+	if (!socket.ReceiveAll(&header, sizeof(header)) || header.size > maxMessageSize) return false;
+	type = header.type;
+	payload.resize(header.size);
+	return header.size == 0 || socket.ReceiveAll(payload.data(), header.size);
+}
+
+uint64_t JobFingerprint(const std::string& description)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (unsigned char c : description) {
+		hash ^= c;
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+bool ParseEndpoint(const std::string& text, std::string& host, int& port)
+{
+	size_t colon = text.rfind(':');
+	host = colon == std::string::npos ? "127.0.0.1" : text.substr(0, colon);
+	std::string digits = colon == std::string::npos ? text : text.substr(colon + 1);
+	if (host.empty() || digits.empty() || digits.size() > 5) return false;
+	port = 0;
+	for (char c : digits) {
+		if (c < '0' || c > '9') return false;
+		port = port * 10 + (c - '0');
+	}
+	return port > 0 && port < 65536;
+}
+
+TileCoordinator::~TileCoordinator()
+{
+	Shutdown();
+}
+
+bool TileCoordinator::Listen(int port, bool localOnly, std::string& error)
+{
+	if (!listener.Listen(port, localOnly, error)) return false;
+	listener.SetNonBlocking();
+	return true;
+}
+
+void TileCoordinator::Shutdown()
+{
+	for (Worker& worker : workers) SendTileMessage(worker.socket, MessageType::Done, nullptr, 0);
+	workers.clear();
+}
+
+std::vector<int> TileCoordinator::Render(const std::vector<TileRequest>& tiles, const ResultCallback& onResult, const TickCallback& tick)
+{
+	using Clock = std::chrono::steady_clock;
+	const int n = static_cast<int>(tiles.size());
+	pending.clear();
+	for (int t = 0; t < n; ++t) pending.push_back(t);
+	finished.assign(n, false);
+	finishedCount = 0;
+	for (Worker& worker : workers) worker.outstanding.clear();
+
+	auto lastWorkerSeen = Clock::now();
+	std::vector<const Socket*> sockets;
+	std::vector<bool> ready;
+	std::vector<unsigned char> chunk(64 * 1024);
+
+	while (finishedCount < n) {
+		if (tick && !tick()) break;
+
+		sockets.clear();
+		sockets.push_back(&listener);
+		for (const Worker& worker : workers) sockets.push_back(&worker.socket);
+		Socket::WaitReadable(sockets, ready, std::chrono::milliseconds(100));
+
+		// Backwards, so dropping a worker does not move the ones still to visit.
+		// Workers accepted below are not in ready yet.
+		for (size_t i = sockets.size() - 1; i >= 1; --i) {
+			if (!ready[i]) continue;
+			Worker& worker = workers[i - 1];
+			bool alive = true;
+			long received;
+			while ((received = worker.socket.ReceiveSome(chunk.data(), chunk.size())) > 0)
+				worker.buffer.insert(worker.buffer.end(), chunk.begin(), chunk.begin() + received);
+			if (received < 0) alive = false;
+			if (!HandleMessages(worker, tiles, onResult)) alive = false;
+			if (!alive) DropWorker(i - 1);
+		}
+		if (ready[0]) AcceptWorkers();
+
+		// A connection that never says hello, such as a port scan on
+		// --listen, must not hold the render back.
+		const auto now = Clock::now();
+		for (size_t i = workers.size(); i-- > 0;) {
+			if (workers[i].greeted || now - workers[i].accepted <= helloWait) continue;
+			if (verbose) std::cerr << "\nDropped " << workers[i].name << ": it did not say hello.\n";
+			DropWorker(i);
+		}
+		FeedWorkers(tiles);
+
+		if (GetWorkerCount() > 0)
+			lastWorkerSeen = now;
+		else if (now - lastWorkerSeen > workerWait)
+			break;
+	}
+
+	// Late results for these are ignored, since they are no longer outstanding.
+	for (Worker& worker : workers) worker.outstanding.clear();
+	std::vector<int> left;
+	for (int t = 0; t < n; ++t)
+		if (!finished[t]) left.push_back(t);
+	return left;
+}
+
+void TileCoordinator::AcceptWorkers()
+{
+	while (true) {
+		Socket socket = listener.Accept();
+		if (!socket.IsValid()) return;
+		socket.SetNonBlocking();
+		Worker worker;
+		worker.socket = std::move(socket);
+		worker.accepted = std::chrono::steady_clock::now();
+		worker.name = "worker " + std::to_string(++connectedWorkers);
+		workers.push_back(std::move(worker));
+	}
+}
+
+bool TileCoordinator::HandleMessages(Worker& worker, const std::vector<TileRequest>& tiles, const ResultCallback& onResult)
+{
+	size_t offset = 0;
+	bool ok = true;
+	std::vector<real> sums;
+	while (ok && worker.buffer.size() - offset >= sizeof(MessageHeader)) {
+		MessageHeader header;
+		std::memcpy(&header, worker.buffer.data() + offset, sizeof(header));
+		if (header.size > maxMessageSize) { ok = false; break; }
+		if (worker.buffer.size() - offset - sizeof(header) < header.size) break;
+		const unsigned char* payload = worker.buffer.data() + offset + sizeof(header);
+		offset += sizeof(header) + header.size;
+
+		if (header.type == MessageType::Hello && !worker.greeted && header.size == sizeof(HelloMessage)) {
+			HelloMessage hello;
+			std::memcpy(&hello, payload, sizeof(hello));
+			if (hello.version != tileProtocolVersion || hello.realSize != sizeof(real) || hello.fingerprint != fingerprint) {
+				// Just closing the connection makes the worker exit with an error.
+				if (verbose) std::cerr << "\nRejected " << worker.name << ": it was started for a different job.\n";
+				ok = false;
+				break;
+			}
+			worker.greeted = true;
+			continue;
+		}
+		if (header.type != MessageType::Result || !worker.greeted || header.size < sizeof(TileResultHeader)) {
+			ok = false;
+			break;
+		}
+
+		TileResultHeader result;
+		std::memcpy(&result, payload, sizeof(result));
+		auto it = std::find(worker.outstanding.begin(), worker.outstanding.end(), static_cast<int>(result.tile.id));
+		// Results of a stopped Render() are no longer outstanding.
+		if (it == worker.outstanding.end()) continue;
+		const int index = *it;
+		TileRequest asked = tiles[index];
+		asked.id = static_cast<uint32_t>(index);
+		const size_t values = 3 * static_cast<size_t>(asked.width) * asked.height;
+		if (header.size != sizeof(TileResultHeader) + values * sizeof(real) || std::memcmp(&asked, &result.tile, sizeof(asked)) != 0) {
+			ok = false;
+			break;
+		}
+		worker.outstanding.erase(it);
+		if (finished[index]) continue;
+		sums.resize(values);
+		std::memcpy(sums.data(), payload + sizeof(result), values * sizeof(real));
+		finished[index] = true;
+		finishedCount++;
+		// The caller gets its own request back, id included.
+		result.tile = tiles[index];
+		onResult(result, sums.data());
+	}
+	worker.buffer.erase(worker.buffer.begin(), worker.buffer.begin() + offset);
+	return ok;
+}
+
+void TileCoordinator::DropWorker(size_t index)
+{
+	Worker& worker = workers[index];
+	// Back to the front, in their original order, so they are redone first.
+	for (auto it = worker.outstanding.rbegin(); it != worker.outstanding.rend(); ++it)
+		if (!finished[*it]) {
+			pending.push_front(*it);
+			reissuedTiles++;
+		}
+	if (verbose && !worker.outstanding.empty())
+		std::cerr << "\nLost " << worker.name << ", reissuing " << worker.outstanding.size() << " tiles.\n";
+	workers.erase(workers.begin() + index);
+}
+
+void TileCoordinator::FeedWorkers(const std::vector<TileRequest>& tiles)
+{
+	for (size_t i = workers.size(); i-- > 0;) {
+		Worker& worker = workers[i];
+		if (!worker.greeted) continue;
+		bool alive = true;
+		while (alive && static_cast<int>(worker.outstanding.size()) < tilesInFlight && !pending.empty()) {
+			int t = pending.front();
+			pending.pop_front();
+			worker.outstanding.push_back(t);
+			// On the wire a tile is known by its index in tiles.
+			TileRequest request = tiles[t];
+			request.id = static_cast<uint32_t>(t);
+			alive = SendTileMessage(worker.socket, MessageType::Tile, &request, sizeof(request));
+		}
+		if (!alive) DropWorker(i);
+	}
+}
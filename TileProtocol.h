@@ -0,0 +1,196 @@
+#pragma once
+
+#include "rtweekend.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Wire format and coordinator side of multi-process tile rendering. A
+// coordinator listens on a TCP port; workers (TileWorker) connect, say
+// hello with a fingerprint of the job they were started with, and are then
+// sent tiles. For every tile a worker returns the per-pixel sums of the
+// requested samples in full `real` precision, so a distributed image is
+// identical to a local one.
+//
+// Messages are a MessageHeader followed by size bytes of payload, in host
+// byte order: all machines of a render farm are expected to share one
+// architecture, and the fingerprint rejects builds of another precision.
+
+// Thin blocking TCP socket, closed on destruction. Linux and Windows.
+class Socket
+{
+public:
+	Socket() = default;
+	~Socket();
+	Socket(Socket&& other) noexcept;
+	Socket& operator=(Socket&& other) noexcept;
+	Socket(const Socket&) = delete;
+	Socket& operator=(const Socket&) = delete;
+
+	// Binds to all interfaces, or only to loopback when localOnly is set.
+	// Port 0 picks a free port; GetPort() then returns it.
+	bool Listen(int port, bool localOnly, std::string& error);
+	bool Connect(const std::string& host, int port, std::string& error);
+	// Returns an invalid socket if no connection is pending.
+	Socket Accept();
+
+	bool SendAll(const void* data, size_t size);
+	bool ReceiveAll(void* data, size_t size);
+	// Reads whatever has arrived, up to size bytes, without waiting. Returns
+	// the byte count, 0 if nothing is pending and -1 once the peer is gone.
+	long ReceiveSome(void* data, size_t size);
+	// Makes ReceiveSome and Accept return at once instead of waiting.
+	void SetNonBlocking();
+
+	bool IsValid() const;
+	int GetPort() const;
+	void Close();
+
+	// Waits until one of the sockets has data, a connection or an error to
+	// report, or timeout passes. ready[i] is set for each such socket.
+	static void WaitReadable(const std::vector<const Socket*>& sockets, std::vector<bool>& ready, std::chrono::milliseconds timeout);
+
+private:
+#ifdef _WIN32
+	using Handle = uintptr_t;
+#else
+	using Handle = int;
+#endif
+	explicit Socket(Handle handle) : handle(handle) {}
+	static Handle InvalidHandle();
+
+	Handle handle = InvalidHandle();
+};
+
+enum class MessageType : uint32_t {
+	// Worker to coordinator: protocol version and job fingerprint.
+	Hello = 1,
+	// Coordinator to worker: a TileRequest.
+	Tile = 2,
+	// Worker to coordinator: a TileResultHeader and 3 * width * height reals.
+	Result = 3,
+	// Coordinator to worker: no more tiles, exit.
+	Done = 4,
+};
+
+struct MessageHeader {
+	MessageType type;
+	uint32_t size;
+};
+
+struct HelloMessage {
+	uint32_t version;
+	uint32_t realSize;
+	uint64_t fingerprint;
+};
+
+// Samples [firstSample, lastSample) of a rectangle of pixels.
+struct TileRequest {
+	// Free for the caller of TileCoordinator::Render(); on the wire the
+	// coordinator replaces it with the tile's index.
+	uint32_t id = 0;
+	int32_t x = 0;
+	int32_t y = 0;
+	int32_t width = 0;
+	int32_t height = 0;
+	int32_t firstSample = 0;
+	int32_t lastSample = 0;
+};
+
+struct TileResultHeader {
+	TileRequest tile;
+	// Wall time the worker spent on the tile.
+	double seconds;
+};
+
+const uint32_t tileProtocolVersion = 1;
+
+bool SendTileMessage(Socket& socket, MessageType type, const void* payload, uint32_t size);
+// Blocks for the next message. Returns false once the connection is gone.
+bool ReceiveTileMessage(Socket& socket, MessageType& type, std::vector<unsigned char>& payload);
+
+// FNV-1a hash, used to check that workers render the same job.
+uint64_t JobFingerprint(const std::string& description);
+
+// Parses "host:port", or just "port" for localhost.
+bool ParseEndpoint(const std::string& text, std::string& host, int& port);
+
+// Hands tiles to connected workers and collects their results. Each worker
+// has a couple of tiles in flight so it never waits for the next one. When a
+// worker disconnects, dies or fails its handshake, its outstanding tiles go
+// back to the front of the queue for the others.
+class TileCoordinator
+{
+public:
+	using ResultCallback = std::function<void(const TileResultHeader& result, const real* sums)>;
+	// Called about every 100 ms from Render(); returning false stops it.
+	using TickCallback = std::function<bool()>;
+
+	// Workers must send this fingerprint in their hello to be given tiles.
+	explicit TileCoordinator(uint64_t fingerprint) : fingerprint(fingerprint) {}
+	~TileCoordinator();
+
+	bool Listen(int port, bool localOnly, std::string& error);
+	int GetPort() const { return listener.GetPort(); }
+
+	// Tiles a worker has queued at once.
+	void SetTilesInFlight(int count) { tilesInFlight = std::max(1, count); }
+	// Render() gives up on the workers when no greeted one has been connected
+	// for this long, so the caller can render what is left itself.
+	void SetWorkerWait(std::chrono::milliseconds wait) { workerWait = wait; }
+	void SetVerbose(bool enabled) { verbose = enabled; }
+
+	// Renders tiles on the workers, calling onResult on this thread for
+	// each finished one. Returns the indices of the tiles that were not
+	// finished, because no workers were left or tick asked to stop.
+	std::vector<int> Render(const std::vector<TileRequest>& tiles, const ResultCallback& onResult, const TickCallback& tick);
+	// Tells every worker to exit and closes the connections.
+	void Shutdown();
+
+	// Workers that passed the handshake.
+	int GetWorkerCount() const {
+		return static_cast<int>(std::count_if(workers.begin(), workers.end(), [](const Worker& w) { return w.greeted; }));
+	}
+	// Tiles handed out again after their worker was lost, over all Render() calls.
+	int GetReissuedTiles() const { return reissuedTiles; }
+
+private:
+	struct Worker {
+		Socket socket;
+		bool greeted = false;
+		// Connections that have not said hello by helloWait after this are dropped.
+		std::chrono::steady_clock::time_point accepted;
+		// Bytes received but not yet parsed into messages.
+		std::vector<unsigned char> buffer;
+		// Indices into the tiles of the current Render().
+		std::vector<int> outstanding;
+		std::string name;
+	};
+
+	void AcceptWorkers();
+	// Parses the complete messages in the worker's buffer. Returns false if
+	// the worker broke the protocol.
+	bool HandleMessages(Worker& worker, const std::vector<TileRequest>& tiles, const ResultCallback& onResult);
+	void DropWorker(size_t index);
+	void FeedWorkers(const std::vector<TileRequest>& tiles);
+
+	uint64_t fingerprint;
+	Socket listener;
+	std::vector<Worker> workers;
+	int tilesInFlight = 2;
+	std::chrono::milliseconds workerWait = std::chrono::seconds(10);
+	std::chrono::milliseconds helloWait = std::chrono::seconds(5);
+	bool verbose = true;
+	int connectedWorkers = 0;
+	int reissuedTiles = 0;
+
+	// State of the Render() in flight.
+	std::deque<int> pending;
+	std::vector<bool> finished;
+	int finishedCount = 0;
+};
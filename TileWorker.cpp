@@ -0,0 +1,156 @@
+#include "TileWorker.h"
+
+#include "TileProtocol.h"
+
+#include <cstring>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+extern char** environ;
+#endif
+
+bool TileWorker::Run()
+{
+	// The coordinator may still be starting, so keep trying for a while.
+	Socket socket;
+	std::string error;
+	auto start = Clock::now();
+	while (!socket.Connect(host, port, error)) {
+		if (SecondsSince(start) > 10.0) {
+			std::cerr << error << "\n";
+			return false;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(250));
+	}
+
+	HelloMessage hello{ tileProtocolVersion, static_cast<uint32_t>(sizeof(real)), fingerprint };
+	if (!SendTileMessage(socket, MessageType::Hello, &hello, sizeof(hello))) return false;
+
+	MessageType type;
+	std::vector<unsigned char> payload;
+	std::vector<unsigned char> reply;
+	std::vector<color> sums;
+	int tilesDone = 0;
+	while (ReceiveTileMessage(socket, type, payload)) {
+		if (type == MessageType::Done) {
+			if (verbose) std::cerr << "Worker finished " << tilesDone << " tiles.\n";
+			return true;
+		}
+		if (type != MessageType::Tile || payload.size() != sizeof(TileRequest)) break;
+
+		TileResultHeader result;
+		// Zeroes the padding too, so no stray bytes go over the wire.
+		std::memset(static_cast<void*>(&result), 0, sizeof(result));
+		std::memcpy(&result.tile, payload.data(), sizeof(TileRequest));
+		const TileRequest& tile = result.tile;
+		if (tile.x < 0 || tile.y < 0 || tile.width <= 0 || tile.height <= 0
+			|| tile.x + tile.width > image_width || tile.y + tile.height > image_height) break;
+
+		auto tileStart = Clock::now();
+		sums.assign(static_cast<size_t>(tile.width) * tile.height, color(0, 0, 0));
+		TraceBlock(tile.x, tile.y, tile.width, tile.height, tile.firstSample, tile.lastSample,
+			[&](int x, int y, const color& c) { sums[(y - tile.y) * tile.width + (x - tile.x)] += c; });
+		result.seconds = SecondsSince(tileStart);
+
+		reply.resize(sizeof(result) + 3 * sums.size() * sizeof(real));
+		std::memcpy(reply.data(), &result, sizeof(result));
+		real* values = reinterpret_cast<real*>(reply.data() + sizeof(result));
+		for (size_t i = 0; i < sums.size(); ++i) {
+			real rgb[3] = { sums[i].x(), sums[i].y(), sums[i].z() };
+			std::memcpy(values + 3 * i, rgb, sizeof(rgb));
+		}
+		if (!SendTileMessage(socket, MessageType::Result, reply.data(), static_cast<uint32_t>(reply.size()))) break;
+		tilesDone++;
+	}
+	if (tilesDone == 0) std::cerr << "The coordinator closed the connection; was it started with the same options?\n";
+	else std::cerr << "Lost the connection to the coordinator.\n";
+	return false;
+}
+
+bool SpawnWorkerProcesses(int count, const std::string& program, const std::vector<std::string>& args, int port,
+	std::vector<WorkerProcess>& processes, std::string& error)
+{
+	std::vector<std::string> workerArgs = args;
+	workerArgs.push_back("--worker");
+	workerArgs.push_back("127.0.0.1:" + std::to_string(port));
+
+#ifdef _WIN32
+	char path[MAX_PATH];
+	DWORD length = GetModuleFileNameA(nullptr, path, MAX_PATH);
+	std::string executable = length > 0 && length < MAX_PATH ? std::string(path, length) : program;
+
+	// Quoted the way the C runtime splits a command line back into argv.
+	auto quote = [](const std::string& arg) {
+		std::string quoted = "\"";
+		size_t backslashes = 0;
+		for (char c : arg) {
+			if (c == '\\') { backslashes++; continue; }
+			quoted.append(c == '"' ? 2 * backslashes + 1 : backslashes, '\\');
+			backslashes = 0;
+			quoted += c;
+		}
+		quoted.append(2 * backslashes, '\\');
+		return quoted + "\"";
+	};
+	std::string commandLine = quote(executable);
+	for (const std::string& arg : workerArgs) commandLine += " " + quote(arg);
+
+	for (int i = 0; i < count; ++i) {
+		STARTUPINFOA startup = {};
+		startup.cb = sizeof(startup);
+		PROCESS_INFORMATION info = {};
+		std::vector<char> mutableLine(commandLine.begin(), commandLine.end());
+		mutableLine.push_back('\0');
+		if (!CreateProcessA(executable.c_str(), mutableLine.data(), nullptr, nullptr, FALSE, 0, nullptr, nullptr, &startup, &info)) {
+			error = "cannot start " + executable;
+			return false;
+		}
+		CloseHandle(info.hThread);
+		WorkerProcess process;
+		process.handle = info.hProcess;
+		processes.push_back(process);
+	}
+#else
+	// argv[0] may be a bare name found on PATH; /proc/self/exe is exact on Linux.
+	std::string executable = program;
+	char path[4096];
+	ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+	if (length > 0) executable.assign(path, static_cast<size_t>(length));
+
+	std::vector<char*> argv;
+	argv.push_back(const_cast<char*>(executable.c_str()));
+	for (std::string& arg : workerArgs) argv.push_back(&arg[0]);
+	argv.push_back(nullptr);
+
+	for (int i = 0; i < count; ++i) {
+		WorkerProcess process;
+		if (posix_spawnp(&process.pid, executable.c_str(), nullptr, nullptr, argv.data(), environ) != 0) {
+			error = "cannot start " + executable;
+			return false;
+		}
+		processes.push_back(process);
+	}
+#endif
+	return true;
+}
+
+void WaitForWorkerProcesses(std::vector<WorkerProcess>& processes)
+{
+	for (WorkerProcess& process : processes) {
+#ifdef _WIN32
+		WaitForSingleObject(process.handle, INFINITE);
+		CloseHandle(process.handle);
+#else
+		int status = 0;
+		waitpid(process.pid, &status, 0);
+#endif
+	}
+	processes.clear();
+}
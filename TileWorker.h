@@ -0,0 +1,48 @@
+#pragma once
+
+#include "ImageWriters.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Worker side of multi-process rendering (see TileProtocol.h). Instead of
+// writing an image, Run() connects to a coordinator and renders every tile
+// it is sent on the calling thread, with this writer's packet, wavefront and
+// integrator settings. It returns true once the coordinator says it is done
+// and false if the connection fails or is lost. Run one worker per core.
+class TileWorker : public IImageWriter {
+public:
+	TileWorker(std::string host, int port, uint64_t fingerprint, camera* cam, hittable* world, int image_width, int image_height, int samples_per_pixel, int max_depth) :
+		IImageWriter(cam, world, image_width, image_height, samples_per_pixel, max_depth),
+		host(host), port(port), fingerprint(fingerprint)
+	{
+	}
+
+	bool Run() override;
+	void WriteHeader() override {}
+	void StorePixel(int, int, const color&) override {}
+	void OnFinishedExecution() override {}
+
+private:
+	std::string host;
+	int port;
+	uint64_t fingerprint;
+};
+
+// A worker process started by SpawnWorkerProcesses.
+struct WorkerProcess {
+#ifdef _WIN32
+	void* handle = nullptr;
+#else
+	int pid = -1;
+#endif
+};
+
+// Starts count copies of this program, each with args followed by
+// "--worker 127.0.0.1:port". program is argv[0], used where the running
+// executable cannot be found otherwise.
+bool SpawnWorkerProcesses(int count, const std::string& program, const std::vector<std::string>& args, int port,
+	std::vector<WorkerProcess>& processes, std::string& error);
+// Waits for the processes to exit.
+void WaitForWorkerProcesses(std::vector<WorkerProcess>& processes);
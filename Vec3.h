@@ -1,100 +1,129 @@
 #pragma once
 
+#include "real.h"
+
 #include <cmath>
 #include <iostream>
 
-struct vec3
+template <typename T>
+struct vec3_t
 {
 public:
-	vec3() : e{ 0,0,0 } {}
-	vec3(double e0, double e1, double e2) : e{ e0, e1, e2 } {}
-	double x() const { return e[0]; }
-	double y() const { return e[1]; }
-	double z() const { return e[2]; }
-	vec3 operator-() const { return vec3(-e[0], -e[1], -e[2]); }
-	double operator[](int i) const { return e[i]; }
-	double& operator[](int i) { return e[i]; }
-	vec3& operator+=(const vec3& v) {
+	using value_type = T;
+
+	vec3_t() : e{ 0,0,0 } {}
+	vec3_t(T e0, T e1, T e2) : e{ e0, e1, e2 } {}
+	T x() const { return e[0]; }
+	T y() const { return e[1]; }
+	T z() const { return e[2]; }
+	vec3_t operator-() const { return vec3_t(-e[0], -e[1], -e[2]); }
+	T operator[](int i) const { return e[i]; }
+	T& operator[](int i) { return e[i]; }
+	vec3_t& operator+=(const vec3_t& v) {
 		e[0] += v.e[0];
 		e[1] += v.e[1];
 		e[2] += v.e[2];
 		return *this;
 	}
-	vec3& operator*=(const double t) {
+	vec3_t& operator*=(const T t) {
 		e[0] *= t;
 		e[1] *= t;
 		e[2] *= t;
 		return *this;
 	}
-	vec3& operator/=(const double t) {
+	vec3_t& operator/=(const T t) {
 		return *this *= 1 / t;
 	}
-	double length() const {
-		return sqrt(length_squared());
+	T length() const {
+		return std::sqrt(length_squared());
 	}
-	double length_squared() const {
+	T length_squared() const {
 		return e[0] * e[0] + e[1] * e[1] + e[2] * e[2];
 	}
 	bool near_zero() const {
-		const auto s = 1e-8;
-		return (fabs(e[0]) < s) && (fabs(e[1]) < s) && (fabs(e[2]) < s);
+		const T s = static_cast<T>(1e-8);
+		return (std::fabs(e[0]) < s) && (std::fabs(e[1]) < s) && (std::fabs(e[2]) < s);
 	}
 public:
-	double e[3];
+	T e[3];
 };
 
 // Type aliases for vec3
+using vec3 = vec3_t<real>;
 using point3 = vec3; // 3D point
 using color = vec3; // RGB color
 
-// vec3 Utility Functions
-inline std::ostream& operator<<(std::ostream& out, const vec3& v) {
+// vec3 Utility Functions. Scalars are taken as value_type so literals and
+// mixed precision arguments convert instead of failing deduction.
+template <typename T>
+inline std::ostream& operator<<(std::ostream& out, const vec3_t<T>& v) {
 	return out << v.e[0] << ' ' << v.e[1] << ' ' << v.e[2];
 }
-inline vec3 operator+(const vec3& u, const vec3& v) {
-	return vec3(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
+template <typename T>
+inline vec3_t<T> operator+(const vec3_t<T>& u, const vec3_t<T>& v) {
+	return vec3_t<T>(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
 }
-inline vec3 operator-(const vec3& u, const vec3& v) {
-	return vec3(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
+template <typename T>
+inline vec3_t<T> operator-(const vec3_t<T>& u, const vec3_t<T>& v) {
+	return vec3_t<T>(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
 }
-inline vec3 operator*(const vec3& u, const vec3& v) {
-	return vec3(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
+template <typename T>
+inline vec3_t<T> operator*(const vec3_t<T>& u, const vec3_t<T>& v) {
+	return vec3_t<T>(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
 }
-inline vec3 operator*(double t, const vec3& v) {
-	return vec3(t * v.e[0], t * v.e[1], t * v.e[2]);
+template <typename T>
+inline vec3_t<T> operator*(typename vec3_t<T>::value_type t, const vec3_t<T>& v) {
+	return vec3_t<T>(t * v.e[0], t * v.e[1], t * v.e[2]);
 }
-inline vec3 operator*(const vec3& v, double t) {
+template <typename T>
+inline vec3_t<T> operator*(const vec3_t<T>& v, typename vec3_t<T>::value_type t) {
 	return t * v;
 }
-inline vec3 operator/(vec3 v, double t) {
+template <typename T>
+inline vec3_t<T> operator/(vec3_t<T> v, typename vec3_t<T>::value_type t) {
 	return (1 / t) * v;
 }
-inline double dot(const vec3& u, const vec3& v) {
+template <typename T>
+inline T dot(const vec3_t<T>& u, const vec3_t<T>& v) {
 	return u.e[0] * v.e[0]
 		+ u.e[1] * v.e[1]
 		+ u.e[2] * v.e[2];
 }
-inline vec3 cross(const vec3& u, const vec3& v) {
-	return vec3(u.e[1] * v.e[2] - u.e[2] * v.e[1],
+template <typename T>
+inline vec3_t<T> cross(const vec3_t<T>& u, const vec3_t<T>& v) {
+	return vec3_t<T>(u.e[1] * v.e[2] - u.e[2] * v.e[1],
 		u.e[2] * v.e[0] - u.e[0] * v.e[2],
 		u.e[0] * v.e[1] - u.e[1] * v.e[0]);
 }
-inline vec3 unit_vector(vec3 v) {
+template <typename T>
+inline vec3_t<T> unit_vector(vec3_t<T> v) {
 	return v / v.length();
 }
 
 #include "rtweekend.h"
-inline static vec3 random() {
+inline vec3 random_vec3() {
 	return vec3(random_double(), random_double(), random_double());
 }
 
-inline static vec3 random(double min, double max) {
+inline vec3 random_vec3(real min, real max) {
 	return vec3(random_double(min, max), random_double(min, max), random_double(min, max));
 }
 
+inline vec3 random_vec3(sampler& rng, real min, real max) {
+	return vec3(random_double(rng, min, max), random_double(rng, min, max), random_double(rng, min, max));
+}
+
 inline vec3 random_in_unit_sphere() {
 	while (true) {
-		auto p = random(-1, 1);
+		auto p = random_vec3(-1, 1);
+		if (p.length_squared() >= 1) continue;
+		return p;
+	}
+}
+
+inline vec3 random_in_unit_sphere(sampler& rng) {
+	while (true) {
+		auto p = random_vec3(rng, -1, 1);
 		if (p.length_squared() >= 1) continue;
 		return p;
 	}
@@ -104,6 +133,10 @@ inline vec3 random_unit_vector() {
 	return unit_vector(random_in_unit_sphere());
 }
 
+inline vec3 random_unit_vector(sampler& rng) {
+	return unit_vector(random_in_unit_sphere(rng));
+}
+
 inline vec3 random_in_hemisphere(const vec3& normal) {
 	vec3 in_unit_sphere = random_in_unit_sphere();
 	if (dot(in_unit_sphere, normal) > 0.0) // In the same hemisphere as the normal
@@ -116,10 +149,10 @@ inline vec3 reflect(const vec3& v, const vec3& n) {
 	return v - 2 * dot(v, n) * n;
 }
 
-inline vec3 refract(const vec3& uv, const vec3& n, double etai_over_etat) {
-	auto cos_theta = fmin(dot(-uv, n), 1.0);
+inline vec3 refract(const vec3& uv, const vec3& n, real etai_over_etat) {
+	real cos_theta = std::fmin(dot(-uv, n), real(1));
 	vec3 r_out_perp = etai_over_etat * (uv + cos_theta * n);
-	vec3 r_out_parallel = -sqrt(fabs(1.0 - r_out_perp.length_squared())) * n;
+	vec3 r_out_parallel = -std::sqrt(std::fabs(real(1) - r_out_perp.length_squared())) * n;
 	return r_out_perp + r_out_parallel;
 }
 
@@ -131,9 +164,9 @@ inline vec3 random_in_unit_disk() {
 	}
 }
 
-inline vec3 threadsafe_random_in_unit_disk() {
+inline vec3 random_in_unit_disk(sampler& rng) {
 	while (true) {
-		auto p = vec3(threadsafe_random_double(-1, 1), threadsafe_random_double(-1, 1), 0);
+		auto p = vec3(random_double(rng, -1, 1), random_double(rng, -1, 1), 0);
 		if (p.length_squared() >= 1) continue;
 		return p;
 	}
@@ -1,20 +1,14 @@
 #include "WorkerThread.h"
 
-#include <iostream>
-
-WorkerThread::WorkerThread(int id, IFinishedTask* task)	: _id(id), _onFinished(task), _task(nullptr) {}
-
-void WorkerThread::AssignTask(IWorkerAction* task)
-{
-	if(task != nullptr) this->_task = task;
-	//std::cerr << "Assigned a task to a thread: " << _task << std::endl;
-}
+WorkerThread::WorkerThread(int id, ITaskSource* source, IFinishedTask* onFinished)
+	: _id(id), _source(source), _onFinished(onFinished) {}
 
 void WorkerThread::run()
 {
-	//std::cerr << "Worker Thread Started: Task == " << _task << std::endl;
-	if (this->_task != nullptr) this->_task->OnStartTask();
+	while (IWorkerAction* task = this->_source->AcquireTask(_id)) {
+		// Owners may reuse a task once it reports back, so the pointer is not touched after this.
+		task->OnStartTask();
 
-	if (_onFinished != nullptr) _onFinished->OnFinishedTask(_id);
-	//std::cerr << "Worker Thread Finished: Finish == " << _onFinished << std::endl;
+		if (_onFinished != nullptr) _onFinished->OnFinishedTask(_id);
+	}
 }
@@ -9,20 +9,26 @@ public:
 	virtual void OnFinishedTask(int id) = 0;
 };
 
+class ITaskSource
+{
+public:
+	// Blocks until a task is available. Returns nullptr once the source is shutting down.
+	virtual IWorkerAction* AcquireTask(int id) = 0;
+};
+
+// Long-lived worker that keeps pulling tasks from its source until it is shut down.
 class WorkerThread : public IThread
 {
 public:
-	WorkerThread(int id, IFinishedTask* task);
+	WorkerThread(int id, ITaskSource* source, IFinishedTask* onFinished);
 	~WorkerThread() {}
 
-	void AssignTask(IWorkerAction* _task);
 	int GetID() const { return _id; }
 
 private:
 	void run() override;
 
 	int _id;
+	ITaskSource* _source = nullptr;
 	IFinishedTask* _onFinished = nullptr;
-	IWorkerAction* _task = nullptr;
 };
-
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "rtweekend.h"
+
+#include <algorithm>
+#include <utility>
+
+class aabb {
+public:
+	aabb() : minimum(infinity, infinity, infinity), maximum(-infinity, -infinity, -infinity) {}
+	aabb(const point3& a, const point3& b) : minimum(a), maximum(b) {}
+	point3 min() const { return minimum; }
+	point3 max() const { return maximum; }
+	point3 centroid() const { return real(0.5) * (minimum + maximum); }
+	bool is_empty() const {
+		return minimum.x() > maximum.x() || minimum.y() > maximum.y() || minimum.z() > maximum.z();
+	}
+	real surface_area() const {
+		if (is_empty()) return 0.0;
+		vec3 d = maximum - minimum;
+		return 2.0 * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+	}
+	int longest_axis() const {
+		vec3 d = maximum - minimum;
+		if (d.x() > d.y() && d.x() > d.z()) return 0;
+		return d.y() > d.z() ? 1 : 2;
+	}
+	void expand(const point3& p) {
+		// std::min/max inline to compares where fmin/fmax are library calls.
+		minimum = point3(std::min(minimum.x(), p.x()), std::min(minimum.y(), p.y()), std::min(minimum.z(), p.z()));
+		maximum = point3(std::max(maximum.x(), p.x()), std::max(maximum.y(), p.y()), std::max(maximum.z(), p.z()));
+	}
+	void expand(const aabb& box) {
+		expand(box.minimum);
+		expand(box.maximum);
+	}
+	inline bool hit(const ray& r, real t_min, real t_max) const {
+		// Slab test, Andrew Kensler's formulation.
+		for (int a = 0; a < 3; a++) {
+			real invD = 1 / r.dir[a];
+			auto t0 = (minimum[a] - r.orig[a]) * invD;
+			auto t1 = (maximum[a] - r.orig[a]) * invD;
+			if (invD < 0.0) std::swap(t0, t1);
+			t_min = t0 > t_min ? t0 : t_min;
+			t_max = t1 < t_max ? t1 : t_max;
+			if (t_max <= t_min) return false;
+		}
+		return true;
+	}
+public:
+	point3 minimum;
+	point3 maximum;
+};
+
+inline aabb surrounding_box(const aabb& box0, const aabb& box1) {
+	aabb box = box0;
+	box.expand(box1);
+	return box;
+}
@@ -0,0 +1,187 @@
+#include "bvh.h"
+
+#include "ray_packet.h"
+#include "sphere.h"
+#include "sphere_soup.h"
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+
+struct bvh_primitive {
+	shared_ptr<hittable> object;
+	aabb box;
+	point3 centroid;
+	// Set when the object is a plain sphere that can be packed into a sphere_soup leaf.
+	const sphere* as_sphere;
+};
+
+// What the recursive build shares across the whole tree.
+struct bvh_build {
+	int soup_leaf_size;
+	// Created with the first soup leaf.
+	shared_ptr<material_table> materials;
+	std::unique_ptr<material_table_builder> material_ids;
+};
+
+namespace {
+	// Number of centroid buckets evaluated per axis when searching for a split.
+	const int sah_bucket_count = 16;
+
+	struct sah_bucket {
+		int count = 0;
+		aabb bounds;
+	};
+
+	// Finds the bucket boundary with the lowest SAH cost over all three axes.
+	// Returns false when every centroid falls into a single bucket.
+	bool find_sah_split(const std::vector<bvh_primitive>& primitives, size_t start, size_t end,
+		const aabb& centroid_bounds, int& best_axis, real& best_position) {
+		real best_cost = infinity;
+
+		for (int axis = 0; axis < 3; axis++) {
+			real axis_min = centroid_bounds.minimum[axis];
+			real extent = centroid_bounds.maximum[axis] - axis_min;
+			if (extent <= 0.0) continue;
+
+			sah_bucket buckets[sah_bucket_count];
+			for (size_t i = start; i < end; i++) {
+				int b = static_cast<int>(sah_bucket_count * ((primitives[i].centroid[axis] - axis_min) / extent));
+				if (b >= sah_bucket_count) b = sah_bucket_count - 1;
+				buckets[b].count++;
+				buckets[b].bounds.expand(primitives[i].box);
+			}
+
+			// Sweep from the right to get the cost of every right-hand side once.
+			real right_area[sah_bucket_count];
+			int right_count[sah_bucket_count];
+			aabb accumulated;
+			int accumulated_count = 0;
+			for (int b = sah_bucket_count - 1; b > 0; b--) {
+				accumulated.expand(buckets[b].bounds);
+				accumulated_count += buckets[b].count;
+				right_area[b] = accumulated.surface_area();
+				right_count[b] = accumulated_count;
+			}
+
+			accumulated = aabb();
+			accumulated_count = 0;
+			for (int b = 0; b < sah_bucket_count - 1; b++) {
+				accumulated.expand(buckets[b].bounds);
+				accumulated_count += buckets[b].count;
+				if (accumulated_count == 0 || right_count[b + 1] == 0) continue;
+				real cost = accumulated.surface_area() * accumulated_count
+					+ right_area[b + 1] * right_count[b + 1];
+				if (cost < best_cost) {
+					best_cost = cost;
+					best_axis = axis;
+					best_position = axis_min + extent * (b + 1) / sah_bucket_count;
+				}
+			}
+		}
+
+		return best_cost < infinity;
+	}
+}
+
+bvh_node::bvh_node(const std::vector<shared_ptr<hittable>>& src_objects, int soup_leaf_size)
+{
+	std::vector<bvh_primitive> primitives;
+	primitives.reserve(src_objects.size());
+	for (const auto& object : src_objects) {
+		bvh_primitive primitive;
+		if (!object->bounding_box(primitive.box)) {
+			std::cerr << "bvh_node: skipping object without a bounding box.\n";
+			continue;
+		}
+		primitive.object = object;
+		primitive.centroid = primitive.box.centroid();
+		primitive.as_sphere = dynamic_cast<const sphere*>(object.get());
+		primitives.push_back(primitive);
+	}
+	if (primitives.empty()) return;
+	bvh_build state{ soup_leaf_size, nullptr, nullptr };
+	build(primitives, 0, primitives.size(), state);
+}
+
+void bvh_node::hit_packet(ray_packet& packet, real t_min) const
+{
+	RT_COUNT(node_visits);
+	if (!left || !packet.may_hit(box, t_min)) return;
+	const hittable* first = left.get();
+	const hittable* second = right.get();
+	if (packet.is_negative(split_axis)) std::swap(first, second);
+	first->hit_packet(packet, t_min);
+	if (second != first) second->hit_packet(packet, t_min);
+}
+
+bvh_node::bvh_node(std::vector<bvh_primitive>& primitives, size_t start, size_t end, bvh_build& state)
+{
+	build(primitives, start, end, state);
+}
+
+void bvh_node::build(std::vector<bvh_primitive>& primitives, size_t start, size_t end, bvh_build& state)
+{
+	const size_t count = end - start;
+
+	aabb centroid_bounds;
+	for (size_t i = start; i < end; i++) {
+		box.expand(primitives[i].box);
+		centroid_bounds.expand(primitives[i].centroid);
+	}
+	split_axis = centroid_bounds.longest_axis();
+
+	if (count == 1) {
+		left = right = primitives[start].object;
+		return;
+	}
+	if (count <= static_cast<size_t>(state.soup_leaf_size)) {
+		bool all_spheres = true;
+		for (size_t i = start; i < end && all_spheres; i++)
+			all_spheres = primitives[i].as_sphere != nullptr;
+		if (all_spheres) {
+			if (!state.materials) {
+				state.materials = make_shared<material_table>();
+				state.material_ids = std::make_unique<material_table_builder>(*state.materials);
+			}
+			auto soup = make_shared<sphere_soup>(state.materials);
+			for (size_t i = start; i < end; i++) {
+				const sphere* s = primitives[i].as_sphere;
+				soup->add(s->center, s->radius, state.material_ids->add(s->mat_ptr.get()));
+			}
+			left = right = soup;
+			return;
+		}
+	}
+	if (count == 2) {
+		left = primitives[start].object;
+		right = primitives[start + 1].object;
+		if (primitives[start + 1].centroid[split_axis] < primitives[start].centroid[split_axis])
+			std::swap(left, right);
+		return;
+	}
+
+	// Whether to stop is decided above: single primitives, pairs and ranges
+	// of up to soup_leaf_size spheres become leaves, and every other range is
+	// split, so the SAH has no leaf cost and only picks where. Ranges it
+	// cannot separate (e.g. coincident centroids) fall back to a median
+	// split on the longest axis.
+	size_t mid = start;
+	int axis = split_axis;
+	real position = 0.0;
+	if (find_sah_split(primitives, start, end, centroid_bounds, axis, position)) {
+		auto it = std::partition(primitives.begin() + start, primitives.begin() + end,
+			[axis, position](const bvh_primitive& p) { return p.centroid[axis] < position; });
+		mid = static_cast<size_t>(it - primitives.begin());
+	}
+	if (mid == start || mid == end) {
+		axis = split_axis;
+		mid = start + count / 2;
+		std::nth_element(primitives.begin() + start, primitives.begin() + mid, primitives.begin() + end,
+			[axis](const bvh_primitive& a, const bvh_primitive& b) { return a.centroid[axis] < b.centroid[axis]; });
+	}
+	split_axis = axis;
+
+	left = shared_ptr<bvh_node>(new bvh_node(primitives, start, mid, state));
+	right = shared_ptr<bvh_node>(new bvh_node(primitives, mid, end, state));
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "hittable.h"
+#include "hittable_list.h"
+#include "render_stats.h"
+
+#include <vector>
+
+struct bvh_primitive;
+struct bvh_build;
+
+// Bounding volume hierarchy over a set of hittables, built top-down with a
+// binned surface area heuristic (SAH). Drop-in replacement for a hittable_list.
+class bvh_node : public hittable {
+public:
+	bvh_node() {}
+	bvh_node(const hittable_list& list) : bvh_node(list.objects) {}
+	// Ranges of up to soup_leaf_size spheres become a single sphere_soup leaf.
+	// Zero keeps one hittable per leaf. The soups of one tree share a single
+	// table of their materials.
+	bvh_node(const hittable_list& list, int soup_leaf_size) : bvh_node(list.objects, soup_leaf_size) {}
+	bvh_node(const std::vector<shared_ptr<hittable>>& src_objects, int soup_leaf_size = 0);
+	virtual bool hit(
+		const ray& r, real t_min, real t_max, hit_record& rec) const override;
+	virtual bool bounding_box(aabb& output_box) const override;
+	virtual void hit_packet(ray_packet& packet, real t_min) const override;
+public:
+	shared_ptr<hittable> left;
+	shared_ptr<hittable> right;
+	aabb box;
+	int split_axis = 0;
+
+private:
+	bvh_node(std::vector<bvh_primitive>& primitives, size_t start, size_t end, bvh_build& state);
+	void build(std::vector<bvh_primitive>& primitives, size_t start, size_t end, bvh_build& state);
+};
+
+inline bool bvh_node::hit(const ray& r, real t_min, real t_max, hit_record& rec) const {
+	RT_COUNT(node_visits);
+	if (!left || !box.hit(r, t_min, t_max)) return false;
+	// Visit the child on the near side of the split plane first so the far
+	// child is tested against a tighter t_max.
+	const hittable* first = left.get();
+	const hittable* second = right.get();
+	if (r.dir[split_axis] < 0) std::swap(first, second);
+	bool hit_first = first->hit(r, t_min, t_max, rec);
+	bool hit_second = second != first && second->hit(r, t_min, hit_first ? rec.t : t_max, rec);
+	return hit_first || hit_second;
+}
+
+inline bool bvh_node::bounding_box(aabb& output_box) const {
+	output_box = box;
+	return !box.is_empty();
+}
@@ -8,10 +8,10 @@ public:
 		point3 lookfrom,
 		point3 lookat,
 		vec3 vup,
-		double vfov, // vertical field-of-view in degrees
-		double aspect_ratio,
-		double aperture,
-		double focus_dist
+		real vfov, // vertical field-of-view in degrees
+		real aspect_ratio,
+		real aperture,
+		real focus_dist
 	) {
 		auto theta = degrees_to_radians(vfov);
 		auto h = tan(theta / 2);
@@ -27,16 +27,8 @@ public:
 		lower_left_corner = origin - horizontal / 2 - vertical / 2 - focus_dist * w;
 		lens_radius = aperture / 2;
 	}
-	ray get_ray(double s, double t) const {
-		vec3 rd = lens_radius * random_in_unit_disk();
-		vec3 offset = u * rd.x() + v * rd.y();
-		return ray(
-			origin + offset,
-			lower_left_corner + s * horizontal + t * vertical - origin - offset
-		);
-	}
-	ray threadsafe_get_ray(double s, double t) const {
-		vec3 rd = lens_radius * threadsafe_random_in_unit_disk();
+	ray get_ray(real s, real t, sampler& rng) const {
+		vec3 rd = lens_radius * random_in_unit_disk(rng);
 		vec3 offset = u * rd.x() + v * rd.y();
 		return ray(
 			origin + offset,
@@ -49,5 +41,5 @@ private:
 	vec3 horizontal;
 	vec3 vertical;
 	vec3 u, v, w;
-	double lens_radius;
+	real lens_radius;
 };
\ No newline at end of file
@@ -0,0 +1,59 @@
+# Renders the same image two ways and fails unless the files are identical.
+# Run with cmake -P and these variables:
+#   RENDERER  path to RaytracingInOneWeekend
+#   WORK_DIR  directory for the images and the checkpoint
+#   MODE      workers: a local render against one split over --workers 2
+#             resume: a straight render against one interrupted by --timeout
+#                     and finished with --resume
+#   ARGS      scene and image options shared by every render, ;-separated
+
+if(NOT RENDERER OR NOT WORK_DIR OR NOT MODE)
+	message(FATAL_ERROR "RENDERER, WORK_DIR and MODE must be set")
+endif()
+file(MAKE_DIRECTORY ${WORK_DIR})
+set(expected ${WORK_DIR}/${MODE}-expected.ppm)
+set(actual ${WORK_DIR}/${MODE}-actual.ppm)
+file(REMOVE ${expected} ${actual})
+
+function(render result output)
+	execute_process(COMMAND ${RENDERER} ${ARGS} --quiet -o ${output} ${ARGN}
+		RESULT_VARIABLE code ERROR_VARIABLE errors)
+	set(${result} ${code} PARENT_SCOPE)
+	if(errors)
+		message(STATUS "${errors}")
+	endif()
+endfunction()
+
+render(code ${expected})
+if(NOT code EQUAL 0)
+	message(FATAL_ERROR "The reference render failed (${code})")
+endif()
+
+if(MODE STREQUAL "workers")
+	render(code ${actual} --workers 2)
+	if(NOT code EQUAL 0)
+		message(FATAL_ERROR "The render on worker processes failed (${code})")
+	endif()
+elseif(MODE STREQUAL "resume")
+	set(checkpoint ${WORK_DIR}/resume.checkpoint)
+	file(REMOVE ${checkpoint})
+	# Exits 1 when the timeout cancels it, which is the point.
+	render(code ${actual} --checkpoint ${checkpoint} --timeout 0.5)
+	if(code EQUAL 0)
+		message(FATAL_ERROR "The render finished before its timeout; make the test image larger")
+	endif()
+	if(NOT EXISTS ${checkpoint})
+		message(FATAL_ERROR "The interrupted render left no checkpoint")
+	endif()
+	render(code ${actual} --checkpoint ${checkpoint} --resume)
+	if(NOT code EQUAL 0)
+		message(FATAL_ERROR "The resumed render failed (${code})")
+	endif()
+else()
+	message(FATAL_ERROR "Unknown MODE ${MODE}")
+endif()
+
+execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${expected} ${actual} RESULT_VARIABLE differ)
+if(NOT differ EQUAL 0)
+	message(FATAL_ERROR "${actual} differs from ${expected}")
+endif()
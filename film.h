@@ -0,0 +1,107 @@
+#pragma once
+
+#include "rtweekend.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Running mean and variance of the samples taken for one pixel, used to
+// decide when progressive rendering can stop sampling it.
+struct pixel_estimate {
+	color sum;
+	// Luminance moments are kept in double so long runs do not lose the variance.
+	double luminance_sum = 0.0;
+	double luminance_sum_sq = 0.0;
+	int samples = 0;
+
+	void add(const color& c) {
+		sum += c;
+		double y = 0.2126 * c.x() + 0.7152 * c.y() + 0.0722 * c.z();
+		luminance_sum += y;
+		luminance_sum_sq += y * y;
+		samples++;
+	}
+
+	color mean() const {
+		return samples > 0 ? sum / static_cast<real>(samples) : color(0, 0, 0);
+	}
+
+	// Standard error of the pixel as displayed. The image is written as
+	// sqrt(linear), so an error e in the mean shows up as e / (2 sqrt(mean)).
+	double display_error() const {
+		if (samples < 2) return infinity;
+		double mean_y = luminance_sum / samples;
+		double variance = (luminance_sum_sq - luminance_sum * mean_y) / (samples - 1);
+		double standard_error = std::sqrt(std::fmax(variance, 0.0) / samples);
+		return standard_error / (2.0 * std::sqrt(std::fmax(mean_y, 1e-4)));
+	}
+};
+
+// Accumulation buffer for a whole image, indexed like the renderer (y up).
+// Like HDRFramebuffer, pixels are stored tile by tile and every tile starts
+// on a cache line of its own, so workers adding samples to neighbouring
+// tiles never write the same line. Tiles the scheduler splits further still
+// share lines where the pieces meet.
+class film {
+public:
+	film() {}
+	film(int width, int height, int tile_width, int tile_height) :
+		width(width), height(height),
+		tile_width(std::max(1, std::min(tile_width, width))), tile_height(std::max(1, std::min(tile_height, height)))
+	{
+		tiles_per_row = (width + this->tile_width - 1) / this->tile_width;
+		const int tile_rows = (height + this->tile_height - 1) / this->tile_height;
+		// Smallest run of pixels that is a whole number of cache lines.
+		size_t line_pixels = 1;
+		while (line_pixels * sizeof(pixel_estimate) % cache_line_bytes != 0) line_pixels++;
+		const size_t tile_pixels = static_cast<size_t>(this->tile_width) * this->tile_height;
+		tile_stride = (tile_pixels + line_pixels - 1) / line_pixels * line_pixels;
+
+		// Spare pixels so the first tile can start on a boundary. The heap
+		// aligns blocks to at least 16 bytes, which is enough to find one.
+		storage.resize(tile_stride * tiles_per_row * tile_rows + line_pixels);
+		const uintptr_t address = reinterpret_cast<uintptr_t>(storage.data());
+		for (size_t offset = 0; offset < line_pixels; ++offset) {
+			if ((address + offset * sizeof(pixel_estimate)) % cache_line_bytes == 0) {
+				base_offset = offset;
+				break;
+			}
+		}
+	}
+
+	pixel_estimate& at(int x, int y) {
+		const int tx = x / tile_width;
+		const int ty = y / tile_height;
+		return storage[base_offset + (static_cast<size_t>(ty) * tiles_per_row + tx) * tile_stride
+			+ static_cast<size_t>(y - ty * tile_height) * tile_width + (x - tx * tile_width)];
+	}
+	const pixel_estimate& at(int x, int y) const { return const_cast<film*>(this)->at(x, y); }
+
+	// Every pixel row by row, bottom row first, as checkpoints store them.
+	std::vector<pixel_estimate> row_major() const {
+		std::vector<pixel_estimate> pixels;
+		pixels.reserve(static_cast<size_t>(width) * height);
+		for (int y = 0; y < height; ++y)
+			for (int x = 0; x < width; ++x) pixels.push_back(at(x, y));
+		return pixels;
+	}
+	void set_row_major(const std::vector<pixel_estimate>& pixels) {
+		size_t i = 0;
+		for (int y = 0; y < height; ++y)
+			for (int x = 0; x < width; ++x) at(x, y) = pixels[i++];
+	}
+
+public:
+	int width = 0;
+	int height = 0;
+
+private:
+	static constexpr size_t cache_line_bytes = 64;
+	int tile_width = 1;
+	int tile_height = 1;
+	int tiles_per_row = 0;
+	size_t tile_stride = 0;
+	size_t base_offset = 0;
+	std::vector<pixel_estimate> storage;
+};
@@ -1,14 +1,18 @@
 #pragma once
 
 #include "rtweekend.h"
+#include "aabb.h"
 
 class material;
+struct ray_packet;
 
 struct hit_record {
 	point3 p;
 	vec3 normal;
-	shared_ptr<material> mat_ptr;
-	double t;
+	// Non-owning. The scene keeps materials alive for as long as it is rendered,
+	// so hits never touch a reference count.
+	const material* mat_ptr = nullptr;
+	real t;
 	bool front_face;
 	inline void set_face_normal(const ray& r, const vec3& outward_normal) {
 		front_face = dot(r.direction(), outward_normal) < 0;
@@ -18,5 +22,11 @@ struct hit_record {
 
 class hittable {
 public:
-	virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const = 0;
+	// Only writes rec when it finds a hit in [t_min, t_max].
+	virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const = 0;
+	// Returns false if the object has no finite bounds.
+	virtual bool bounding_box(aabb& output_box) const = 0;
+	// Finds the closest hit of every ray in the packet. The default traces
+	// them one at a time; acceleration structures cull the whole packet.
+	virtual void hit_packet(ray_packet& packet, real t_min) const;
 };
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "hittable.h"
+#include "scene_arena.h"
 
 #include <memory>
 #include <vector>
@@ -14,21 +15,38 @@ public:
 	hittable_list(shared_ptr<hittable> object) { add(object); }
 	void clear() { objects.clear(); }
 	void add(shared_ptr<hittable> object) { objects.push_back(object); }
+	// Storage for this scene's objects and materials, created on first use.
+	// Copies of the list share it, and the objects made in it keep it alive.
+	scene_arena& arena() {
+		if (!storage) storage = make_shared<scene_arena>();
+		return *storage;
+	}
 	virtual bool hit(
-		const ray& r, double t_min, double t_max, hit_record& rec) const override;
+		const ray& r, real t_min, real t_max, hit_record& rec) const override;
+	virtual bool bounding_box(aabb& output_box) const override;
 public:
+	shared_ptr<scene_arena> storage;
 	std::vector<shared_ptr<hittable>> objects;
 };
-inline bool hittable_list::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
-	hit_record temp_rec;
+inline bool hittable_list::hit(const ray& r, real t_min, real t_max, hit_record& rec) const {
+	// Hittables only write rec when they report a closer hit, so no temporary is needed.
 	bool hit_anything = false;
 	auto closest_so_far = t_max;
 	for (const auto& object : objects) {
-		if (object->hit(r, t_min, closest_so_far, temp_rec)) {
+		if (object->hit(r, t_min, closest_so_far, rec)) {
 			hit_anything = true;
-			closest_so_far = temp_rec.t;
-			rec = temp_rec;
+			closest_so_far = rec.t;
 		}
 	}
 	return hit_anything;
+}
+inline bool hittable_list::bounding_box(aabb& output_box) const {
+	if (objects.empty()) return false;
+	aabb temp_box;
+	output_box = aabb();
+	for (const auto& object : objects) {
+		if (!object->bounding_box(temp_box)) return false;
+		output_box.expand(temp_box);
+	}
+	return true;
 }
\ No newline at end of file
@@ -0,0 +1,31 @@
+#include "instance.h"
+
+instance::instance(shared_ptr<hittable> object, const transform& object_to_world)
+	: object(object), object_to_world(object_to_world)
+{
+	if (auto inner = std::dynamic_pointer_cast<instance>(object)) {
+		this->object = inner->object;
+		this->object_to_world = object_to_world * inner->object_to_world;
+	}
+	aabb object_box;
+	has_box = this->object->bounding_box(object_box);
+	if (has_box) box = this->object_to_world.box(object_box);
+}
+
+bool instance::hit(const ray& r, real t_min, real t_max, hit_record& rec) const
+{
+	ray local(object_to_world.inverse_point(r.orig), object_to_world.inverse_vector(r.dir));
+	if (!object->hit(local, t_min, t_max, rec))
+		return false;
+
+	// The linear part keeps dot(direction, normal) signs, so front_face holds.
+	rec.p = r.at(rec.t);
+	rec.normal = unit_vector(object_to_world.normal(rec.normal));
+	return true;
+}
+
+bool instance::bounding_box(aabb& output_box) const
+{
+	output_box = box;
+	return has_box;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "hittable.h"
+#include "transform.h"
+
+#include <memory>
+
+// A shared hittable placed in the world by a transform. Many instances can
+// point at the same object, so repeated assets are stored once; a bvh_node
+// over instances whose objects are bvh_nodes themselves makes a two-level
+// hierarchy (top level over instances, bottom level per asset).
+//
+// Rays are moved into object space rather than the geometry into world
+// space. The direction is not renormalized, so hit distances are the same
+// in both spaces.
+class instance : public hittable {
+public:
+	instance(shared_ptr<hittable> object, const transform& object_to_world);
+
+	virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override;
+	virtual bool bounding_box(aabb& output_box) const override;
+
+public:
+	shared_ptr<hittable> object;
+	transform object_to_world;
+
+private:
+	aabb box;
+	bool has_box = false;
+};
+
+// Wrappers for a single transform. Wrapping an instance folds the
+// transforms together, so chains cost one object-space hop.
+class translate : public instance {
+public:
+	translate(shared_ptr<hittable> object, const vec3& offset)
+		: instance(object, transform::translate(offset)) {}
+};
+
+class rotate : public instance {
+public:
+	rotate(shared_ptr<hittable> object, const vec3& axis, real degrees)
+		: instance(object, transform::rotate(axis, degrees)) {}
+};
+
+class scale : public instance {
+public:
+	scale(shared_ptr<hittable> object, real factor)
+		: instance(object, transform::scale(factor)) {}
+	scale(shared_ptr<hittable> object, const vec3& factors)
+		: instance(object, transform::scale(factors)) {}
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "rtweekend.h"
+#include "hittable.h"
+#include "material.h"
+#include "render_stats.h"
+
+struct integrator_settings {
+	// Paths are cut off after this many bounces.
+	int max_depth = 50;
+	// Bounces always taken before Russian roulette may end a path.
+	int min_bounces = 3;
+	bool russian_roulette = true;
+};
+
+inline color background_color(const ray& r) {
+	vec3 unit_direction = unit_vector(r.direction());
+	real t = real(0.5) * (unit_direction.y() + 1);
+	return (1 - t) * color(1, 1, 1) + t * color(real(0.5), real(0.7), 1);
+}
+
+// Iterative path tracer. The product of attenuations along the path is kept
+// as a throughput; once min_bounces are done, paths survive each bounce with
+// probability equal to their brightest throughput channel and are reweighted,
+// so dim paths end early without biasing the estimate.
+// The first intersection of r is passed in, so primary rays can be traced
+// as packets and continue here one path at a time.
+inline color trace_path(const ray& r, bool first_hit, const hit_record& first_rec,
+	const hittable& world, const integrator_settings& settings, sampler& rng) {
+	if (settings.max_depth <= 0) return color(0, 0, 0);
+
+	hit_record rec = first_rec;
+	color throughput(1.0, 1.0, 1.0);
+	ray current = r;
+
+	for (int bounce = 0; bounce < settings.max_depth; ++bounce) {
+		bool found = bounce == 0 ? first_hit : world.hit(current, 0.001, infinity, rec);
+		if (bounce == 0) RT_COUNT(primary_rays); else RT_COUNT(secondary_rays);
+		if (!found) {
+			RT_COUNT(ray_misses);
+			RT_COUNT_PATH(bounce + 1);
+			return throughput * background_color(current);
+		}
+		RT_COUNT(ray_hits);
+
+		ray scattered;
+		color attenuation;
+		if (!rec.mat_ptr->scatter(current, rec, attenuation, scattered, rng)) {
+			RT_COUNT(absorbed[static_cast<int>(rec.mat_ptr->type)]);
+			RT_COUNT_PATH(bounce + 1);
+			return color(0, 0, 0);
+		}
+		RT_COUNT(scattered[static_cast<int>(rec.mat_ptr->type)]);
+		throughput = throughput * attenuation;
+
+		if (settings.russian_roulette && bounce + 1 >= settings.min_bounces) {
+			real survival = fmin(real(0.95), fmax(throughput.x(), fmax(throughput.y(), throughput.z())));
+			if (random_double(rng) >= survival) {
+				RT_COUNT(roulette_ends);
+				RT_COUNT_PATH(bounce + 1);
+				return color(0, 0, 0);
+			}
+			throughput /= survival;
+		}
+		current = scattered;
+	}
+	RT_COUNT(depth_limit_ends);
+	RT_COUNT_PATH(settings.max_depth);
+	return color(0, 0, 0);
+}
+
+inline color ray_color(const ray& r, const hittable& world, const integrator_settings& settings, sampler& rng) {
+	hit_record rec;
+	bool first_hit = settings.max_depth > 0 && world.hit(r, 0.001, infinity, rec);
+	return trace_path(r, first_hit, rec, world, settings, rng);
+}
+
+// Fixed-depth tracing without Russian roulette, matching the original recursive ray_color.
+inline color ray_color(const ray& r, const hittable& world, int depth, sampler& rng) {
+	integrator_settings settings;
+	settings.max_depth = depth;
+	settings.russian_roulette = false;
+	return ray_color(r, world, settings, rng);
+}
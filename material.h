@@ -3,20 +3,43 @@
 #include "rtweekend.h"
 #include "hittable.h"
 
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Materials are a tagged union rather than a class hierarchy: scatter()
+// switches on the type and every kernel is inlined into the bounce loop.
+// The tag also lets an integrator group hits by material before shading.
 class material {
 public:
-	virtual bool scatter(
-		const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered
-	) const = 0;
-};
+	enum class kind : uint8_t { lambertian, metal, dielectric };
+	static const int kind_count = 3;
+
+	bool scatter(
+		const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered, sampler& rng
+	) const {
+		switch (type) {
+		case kind::lambertian: return scatter_lambertian(rec, attenuation, scattered, rng);
+		case kind::metal: return scatter_metal(r_in, rec, attenuation, scattered, rng);
+		case kind::dielectric: return scatter_dielectric(r_in, rec, attenuation, scattered, rng);
+		}
+		return false;
+	}
 
-class lambertian : public material {
 public:
-	lambertian(const color& a) : albedo(a) {}
-	virtual bool scatter(
-		const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered
-	) const override {
-		auto scatter_direction = rec.normal + random_unit_vector();
+	color albedo;
+	union {
+		real fuzz; // metal
+		real ir; // dielectric, Index of Refraction
+	};
+	kind type;
+
+protected:
+	material(kind type, const color& albedo, real param) : albedo(albedo), fuzz(param), type(type) {}
+
+private:
+	bool scatter_lambertian(const hit_record& rec, color& attenuation, ray& scattered, sampler& rng) const {
+		auto scatter_direction = rec.normal + random_unit_vector(rng);
 
 		// Catch degenerate scatter direction
 		if (scatter_direction.near_zero())
@@ -26,56 +49,87 @@ public:
 		attenuation = albedo;
 		return true;
 	}
-public:
-	color albedo;
-};
 
-class metal : public material {
-public:
-	metal(const color& a, double f) : albedo(a), fuzz(f < 1 ? f : 1) {}
-	virtual bool scatter(
-		const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered
-	) const override {
+	bool scatter_metal(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered, sampler& rng) const {
 		vec3 reflected = reflect(unit_vector(r_in.direction()), rec.normal);
-		scattered = ray(rec.p, reflected + fuzz * random_in_unit_sphere());
+		scattered = ray(rec.p, reflected + fuzz * random_in_unit_sphere(rng));
 		attenuation = albedo;
 		return (dot(scattered.direction(), rec.normal) > 0);
 	}
-public:
-	color albedo;
-	double fuzz;
-};
 
-class dielectric : public material {
-public:
-	dielectric(double index_of_refraction) : ir(index_of_refraction) {}
-	virtual bool scatter(
-		const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered
-	) const override {
-		attenuation = color(1.0, 1.0, 1.0);
-		double refraction_ratio = rec.front_face ? (1.0 / ir) : ir;
+	bool scatter_dielectric(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered, sampler& rng) const {
+		attenuation = color(1, 1, 1);
+		real refraction_ratio = rec.front_face ? (1 / ir) : ir;
 		vec3 unit_direction = unit_vector(r_in.direction());
-		
-		double cos_theta = fmin(dot(-unit_direction, rec.normal), 1.0);
-		double sin_theta = sqrt(1.0 - cos_theta * cos_theta);
-		bool cannot_refract = refraction_ratio * sin_theta > 1.0;
+
+		real cos_theta = fmin(dot(-unit_direction, rec.normal), real(1));
+		real sin_theta = sqrt(1 - cos_theta * cos_theta);
+		bool cannot_refract = refraction_ratio * sin_theta > 1;
 		vec3 direction;
-		
-		if(cannot_refract || reflectance(cos_theta, refraction_ratio) > random_double())
+
+		if (cannot_refract || reflectance(cos_theta, refraction_ratio) > random_double(rng))
 			direction = reflect(unit_direction, rec.normal);
 		else
 			direction = refract(unit_direction, rec.normal, refraction_ratio);
 		scattered = ray(rec.p, direction);
-		
+
 		return true;
 	}
-public:
-	double ir; // Index of Refractionprivate:
-private:
-	static double reflectance(double cosine, double ref_idx) {
+
+	static real reflectance(real cosine, real ref_idx) {
 		// Use Schlick's approximation for reflectance.
 		auto r0 = (1 - ref_idx) / (1 + ref_idx);
 		r0 = r0 * r0;
 		return r0 + (1 - r0) * pow((1 - cosine), 5);
 	}
-};
\ No newline at end of file
+};
+
+// Constructors for each kind. They add no members, so they convert to
+// material without slicing anything off.
+class lambertian : public material {
+public:
+	lambertian(const color& a) : material(kind::lambertian, a, 0) {}
+};
+
+class metal : public material {
+public:
+	metal(const color& a, real f) : material(kind::metal, a, f < 1 ? f : 1) {}
+};
+
+class dielectric : public material {
+public:
+	dielectric(real index_of_refraction) : material(kind::dielectric, color(1, 1, 1), index_of_refraction) {}
+};
+
+// Materials copied into one contiguous array, so hits against the objects
+// that use it read their material from a few cache lines. A BVH keeps one
+// for its whole scene, and its leaves store only indices into it. Hits
+// point into the table, so it must not grow while it is being rendered.
+class material_table {
+public:
+	uint32_t add(const material& m) {
+		entries.push_back(m);
+		return static_cast<uint32_t>(entries.size() - 1);
+	}
+	const material& operator[](uint32_t id) const { return entries[id]; }
+	size_t size() const { return entries.size(); }
+private:
+	std::vector<material> entries;
+};
+
+// Fills a material_table while building, copying each source material in
+// once however many objects share it. Drop it once the build is done.
+class material_table_builder {
+public:
+	explicit material_table_builder(material_table& table) : table(table) {}
+	uint32_t add(const material* m) {
+		auto found = lookup.find(m);
+		if (found != lookup.end()) return found->second;
+		uint32_t id = table.add(*m);
+		lookup[m] = id;
+		return id;
+	}
+private:
+	material_table& table;
+	std::unordered_map<const material*, uint32_t> lookup;
+};
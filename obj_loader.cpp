@@ -0,0 +1,173 @@
+#include "obj_loader.h"
+
+#include <charconv>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+	// Read-only view of a whole file.
+	class mapped_file {
+	public:
+		explicit mapped_file(const std::string& path) {
+#ifdef _WIN32
+			file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+			if (file == INVALID_HANDLE_VALUE) return;
+			LARGE_INTEGER file_size;
+			if (!GetFileSizeEx(file, &file_size)) return;
+			length = static_cast<size_t>(file_size.QuadPart);
+			opened = true;
+			if (length == 0) return;
+			mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (mapping == nullptr) { opened = false; return; }
+			bytes = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+			opened = bytes != nullptr;
+#else
+			fd = open(path.c_str(), O_RDONLY);
+			if (fd < 0) return;
+			struct stat info;
+			if (fstat(fd, &info) != 0) return;
+			length = static_cast<size_t>(info.st_size);
+			opened = true;
+			if (length == 0) return;
+			void* view = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (view == MAP_FAILED) { opened = false; return; }
+			bytes = static_cast<const char*>(view);
+			madvise(view, length, MADV_SEQUENTIAL);
+#endif
+		}
+		~mapped_file() {
+#ifdef _WIN32
+			if (bytes != nullptr) UnmapViewOfFile(bytes);
+			if (mapping != nullptr) CloseHandle(mapping);
+			if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+			if (bytes != nullptr) munmap(const_cast<char*>(bytes), length);
+			if (fd >= 0) close(fd);
+#endif
+		}
+		mapped_file(const mapped_file&) = delete;
+		mapped_file& operator=(const mapped_file&) = delete;
+
+		bool is_open() const { return opened; }
+		const char* begin() const { return bytes; }
+		const char* end() const { return bytes + length; }
+
+	private:
+		const char* bytes = nullptr;
+		size_t length = 0;
+		bool opened = false;
+#ifdef _WIN32
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping = nullptr;
+#else
+		int fd = -1;
+#endif
+	};
+
+	inline bool is_blank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+	inline void skip_blanks(const char*& p, const char* end) {
+		while (p < end && is_blank(*p)) ++p;
+	}
+
+	inline bool parse_real(const char*& p, const char* end, real& out) {
+		skip_blanks(p, end);
+		if (p < end && *p == '+') ++p;
+		double value = 0.0;
+		auto result = std::from_chars(p, end, value);
+		if (result.ec != std::errc()) return false;
+		p = result.ptr;
+		out = static_cast<real>(value);
+		return true;
+	}
+
+	// Parses one face corner and returns its position index, 1-based or
+	// negative as written. The texture and normal indices are skipped.
+	inline bool parse_corner(const char*& p, const char* end, long long& out) {
+		auto result = std::from_chars(p, end, out);
+		if (result.ec != std::errc() || out == 0) return false;
+		p = result.ptr;
+		while (p < end && !is_blank(*p) && *p != '\n') ++p;
+		return true;
+	}
+}
+
+bool load_obj(const std::string& path, std::vector<point3>& vertices, std::vector<uint32_t>& indices, std::string& error)
+{
+	mapped_file file(path);
+	if (!file.is_open()) {
+		error = "cannot open " + path;
+		return false;
+	}
+
+	const size_t first_vertex = vertices.size();
+	const size_t first_index = indices.size();
+	size_t line_number = 0;
+	auto fail = [&](const char* message) {
+		error = path + ":" + std::to_string(line_number) + ": " + message;
+		return false;
+	};
+
+	// Resolved indices of the current polygon's first and previous corners.
+	uint32_t fan_first = 0;
+	uint32_t fan_previous = 0;
+
+	const char* end = file.end();
+	for (const char* p = file.begin(); p < end; ) {
+		++line_number;
+		skip_blanks(p, end);
+		if (p + 1 < end && p[0] == 'v' && is_blank(p[1])) {
+			p += 1;
+			real x, y, z;
+			if (!parse_real(p, end, x) || !parse_real(p, end, y) || !parse_real(p, end, z))
+				return fail("expected: v <x> <y> <z>");
+			vertices.emplace_back(x, y, z);
+		}
+		else if (p + 1 < end && p[0] == 'f' && is_blank(p[1])) {
+			p += 1;
+			int corners = 0;
+			const size_t count = vertices.size() - first_vertex;
+			while (true) {
+				skip_blanks(p, end);
+				if (p >= end || *p == '\n' || *p == '#') break;
+				long long index;
+				if (!parse_corner(p, end, index)) return fail("bad face index");
+				long long resolved = index > 0 ? index - 1 : static_cast<long long>(count) + index;
+				// Positive indices may point past the vertices read so far; they are checked at the end.
+				if (resolved < 0 || resolved > UINT32_MAX) return fail("face index out of range");
+				uint32_t corner = static_cast<uint32_t>(resolved);
+				if (corners == 0) fan_first = corner;
+				else if (corners >= 2) {
+					indices.push_back(fan_first);
+					indices.push_back(fan_previous);
+					indices.push_back(corner);
+				}
+				fan_previous = corner;
+				corners++;
+			}
+			if (corners < 3) return fail("face with fewer than three corners");
+		}
+		// Skip the rest of the line, including anything unsupported.
+		while (p < end && *p != '\n') ++p;
+		++p;
+	}
+
+	const size_t count = vertices.size() - first_vertex;
+	for (size_t i = first_index; i < indices.size(); i++) {
+		if (indices[i] >= count) {
+			error = path + ": face refers to vertex " + std::to_string(indices[i] + 1) + " of " + std::to_string(count);
+			return false;
+		}
+		indices[i] += static_cast<uint32_t>(first_vertex);
+	}
+	return true;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "rtweekend.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Reads the geometry of a Wavefront OBJ file: v lines and f lines, with
+// v, v/vt, v//vn and v/vt/vn corners, negative (relative) indices, and
+// polygons split into triangle fans. Everything else is skipped.
+//
+// The file is memory mapped and parsed in place with std::from_chars, so
+// no line is copied into a string. Returns false with a message naming the
+// line on a parse error.
+bool load_obj(const std::string& path, std::vector<point3>& vertices, std::vector<uint32_t>& indices, std::string& error);
@@ -0,0 +1,63 @@
+#include "ray_packet.h"
+
+#include <algorithm>
+
+void hittable::hit_packet(ray_packet& packet, real t_min) const
+{
+	for (int i = 0; i < packet.size; i++) {
+		if (hit(packet.rays[i], t_min, packet.t_max[i], packet.rec[i])) {
+			packet.t_max[i] = packet.rec[i].t;
+			packet.hit[i] = true;
+		}
+	}
+}
+
+void ray_packet::prepare()
+{
+	common_signs = size > 0;
+	for (int a = 0; a < 3; a++) {
+		dir_negative[a] = size > 0 && rays[0].dir[a] < 0;
+		origin_lo[a] = inv_lo[a] = infinity;
+		origin_hi[a] = inv_hi[a] = -infinity;
+		for (int i = 0; i < size; i++) {
+			real d = rays[i].dir[a];
+			if (d == 0.0 || (d < 0) != dir_negative[a]) common_signs = false;
+			real inv = 1 / d;
+			origin_lo[a] = std::min(origin_lo[a], rays[i].orig[a]);
+			origin_hi[a] = std::max(origin_hi[a], rays[i].orig[a]);
+			inv_lo[a] = std::min(inv_lo[a], inv);
+			inv_hi[a] = std::max(inv_hi[a], inv);
+		}
+	}
+}
+
+bool ray_packet::interval_cull(const aabb& box, real t_min) const
+{
+	// Interval arithmetic slab test (Boulos et al.): bound every ray's entry
+	// and exit distance for the box from below and above respectively. Works
+	// for rays with different origins, such as depth of field camera rays.
+	real entry_lo = t_min;
+	real exit_hi = infinity;
+	for (int a = 0; a < 3; a++) {
+		real near_plane = dir_negative[a] ? box.maximum[a] : box.minimum[a];
+		real far_plane = dir_negative[a] ? box.minimum[a] : box.maximum[a];
+		// (plane - origin) * inv over the origin and inverse direction intervals.
+		real n0 = near_plane - origin_hi[a], n1 = near_plane - origin_lo[a];
+		real f0 = far_plane - origin_hi[a], f1 = far_plane - origin_lo[a];
+		real entry = std::min(std::min(n0 * inv_lo[a], n0 * inv_hi[a]), std::min(n1 * inv_lo[a], n1 * inv_hi[a]));
+		real exit = std::max(std::max(f0 * inv_lo[a], f0 * inv_hi[a]), std::max(f1 * inv_lo[a], f1 * inv_hi[a]));
+		entry_lo = std::max(entry_lo, entry);
+		exit_hi = std::min(exit_hi, exit);
+		if (exit_hi < entry_lo) return true;
+	}
+	return false;
+}
+
+bool ray_packet::may_hit(const aabb& box, real t_min) const
+{
+	if (common_signs && interval_cull(box, t_min)) return false;
+	for (int i = 0; i < size; i++) {
+		if (box.hit(rays[i], t_min, t_max[i])) return true;
+	}
+	return false;
+}
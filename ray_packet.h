@@ -0,0 +1,41 @@
+#pragma once
+
+#include "hittable.h"
+
+// Up to 64 coherent rays (e.g. the primary rays of an 8x8 pixel block) traced
+// through the scene together. hittable::hit_packet fills in the closest hit
+// of every ray; t_max shrinks per ray as hits are found.
+struct ray_packet {
+	static const int max_size = 64;
+
+	int size = 0;
+	ray rays[max_size];
+	real t_max[max_size];
+	bool hit[max_size];
+	hit_record rec[max_size];
+
+	void clear() { size = 0; }
+	void add(const ray& r) {
+		rays[size] = r;
+		t_max[size] = infinity;
+		hit[size] = false;
+		size++;
+	}
+
+	// Computes the packet bounds used for culling. Call after the last add().
+	void prepare();
+	// Conservative: false only if no ray in the packet can hit the box.
+	bool may_hit(const aabb& box, real t_min) const;
+	// Sign of the packet's direction along an axis, for front-to-back ordering.
+	bool is_negative(int axis) const { return dir_negative[axis]; }
+
+private:
+	// Interval bounds over all rays of the origins and inverse directions.
+	// Only valid when every ray's direction has the same sign on every axis.
+	bool common_signs = false;
+	bool dir_negative[3] = { false, false, false };
+	real origin_lo[3], origin_hi[3];
+	real inv_lo[3], inv_hi[3];
+
+	bool interval_cull(const aabb& box, real t_min) const;
+};
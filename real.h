@@ -0,0 +1,9 @@
+#pragma once
+
+// Floating point type used for geometry and shading. Define
+// RT_SINGLE_PRECISION to build the renderer in float instead of double.
+#ifdef RT_SINGLE_PRECISION
+using real = float;
+#else
+using real = double;
+#endif
@@ -0,0 +1,109 @@
+#include "render_stats.h"
+
+#include <atomic>
+
+uint64_t render_counters::paths() const
+{
+	uint64_t total = 0;
+	for (uint64_t n : path_lengths) total += n;
+	return total;
+}
+
+render_counters& render_counters::operator+=(const render_counters& other)
+{
+	primary_rays += other.primary_rays;
+	secondary_rays += other.secondary_rays;
+	ray_hits += other.ray_hits;
+	ray_misses += other.ray_misses;
+	node_visits += other.node_visits;
+	sphere_tests += other.sphere_tests;
+	sphere_hits += other.sphere_hits;
+	soup_block_tests += other.soup_block_tests;
+	triangle_tests += other.triangle_tests;
+	triangle_hits += other.triangle_hits;
+	for (int k = 0; k < material::kind_count; ++k) {
+		scattered[k] += other.scattered[k];
+		absorbed[k] += other.absorbed[k];
+	}
+	roulette_ends += other.roulette_ends;
+	depth_limit_ends += other.depth_limit_ends;
+	for (int i = 0; i <= max_path_length; ++i)
+		path_lengths[i] += other.path_lengths[i];
+	return *this;
+}
+
+render_counters render_counters::operator-(const render_counters& earlier) const
+{
+	render_counters d;
+	d.primary_rays = primary_rays - earlier.primary_rays;
+	d.secondary_rays = secondary_rays - earlier.secondary_rays;
+	d.ray_hits = ray_hits - earlier.ray_hits;
+	d.ray_misses = ray_misses - earlier.ray_misses;
+	d.node_visits = node_visits - earlier.node_visits;
+	d.sphere_tests = sphere_tests - earlier.sphere_tests;
+	d.sphere_hits = sphere_hits - earlier.sphere_hits;
+	d.soup_block_tests = soup_block_tests - earlier.soup_block_tests;
+	d.triangle_tests = triangle_tests - earlier.triangle_tests;
+	d.triangle_hits = triangle_hits - earlier.triangle_hits;
+	for (int k = 0; k < material::kind_count; ++k) {
+		d.scattered[k] = scattered[k] - earlier.scattered[k];
+		d.absorbed[k] = absorbed[k] - earlier.absorbed[k];
+	}
+	d.roulette_ends = roulette_ends - earlier.roulette_ends;
+	d.depth_limit_ends = depth_limit_ends - earlier.depth_limit_ends;
+	for (int i = 0; i <= max_path_length; ++i)
+		d.path_lengths[i] = path_lengths[i] - earlier.path_lengths[i];
+	return d;
+}
+
+int render_thread_index()
+{
+	static std::atomic<int> next{ 0 };
+	thread_local int index = next++;
+	return index;
+}
+
+namespace {
+	const char* const kind_names[material::kind_count] = { "lambertian", "metal", "dielectric" };
+
+	double ratio(uint64_t a, uint64_t b) {
+		return b > 0 ? static_cast<double>(a) / static_cast<double>(b) : 0.0;
+	}
+}
+
+void write_counters_json(std::ostream& out, const render_counters& c, const char* indent)
+{
+	out << "{\n"
+		<< indent << "  \"primary_rays\": " << c.primary_rays << ",\n"
+		<< indent << "  \"secondary_rays\": " << c.secondary_rays << ",\n"
+		<< indent << "  \"ray_hits\": " << c.ray_hits << ",\n"
+		<< indent << "  \"ray_misses\": " << c.ray_misses << ",\n"
+		<< indent << "  \"node_visits\": " << c.node_visits << ",\n"
+		<< indent << "  \"sphere_tests\": " << c.sphere_tests << ",\n"
+		<< indent << "  \"sphere_hits\": " << c.sphere_hits << ",\n"
+		<< indent << "  \"soup_block_tests\": " << c.soup_block_tests << ",\n"
+		<< indent << "  \"triangle_tests\": " << c.triangle_tests << ",\n"
+		<< indent << "  \"triangle_hits\": " << c.triangle_hits << ",\n"
+		<< indent << "  \"roulette_ends\": " << c.roulette_ends << ",\n"
+		<< indent << "  \"depth_limit_ends\": " << c.depth_limit_ends << ",\n";
+
+	out << indent << "  \"materials\": {";
+	for (int k = 0; k < material::kind_count; ++k) {
+		out << (k ? "," : "") << "\n" << indent << "    \"" << kind_names[k] << "\": { \"scattered\": "
+			<< c.scattered[k] << ", \"absorbed\": " << c.absorbed[k] << " }";
+	}
+	out << "\n" << indent << "  },\n";
+
+	// Trailing zero buckets are left out.
+	int last = render_counters::max_path_length;
+	while (last > 0 && c.path_lengths[last] == 0) --last;
+	out << indent << "  \"path_lengths\": [";
+	for (int i = 0; i <= last; ++i) out << (i ? ", " : "") << c.path_lengths[i];
+	out << "],\n";
+
+	out << indent << "  \"rays_per_path\": " << ratio(c.rays(), c.paths()) << ",\n"
+		<< indent << "  \"node_visits_per_ray\": " << ratio(c.node_visits, c.rays()) << ",\n"
+		<< indent << "  \"sphere_tests_per_ray\": " << ratio(c.sphere_tests, c.rays()) << ",\n"
+		<< indent << "  \"triangle_tests_per_ray\": " << ratio(c.triangle_tests, c.rays()) << "\n"
+		<< indent << "}";
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "material.h"
+
+#include <cstdint>
+#include <ostream>
+
+// Counts of where a render's rays went. Every thread counts into its own
+// thread_counters with plain increments, so the hot path shares no cache
+// lines and takes no atomics; writers take the difference around each tile
+// and add the tiles up once the frame is done.
+struct render_counters {
+	// Paths tracing this many rays or more share the last histogram bucket.
+	static constexpr int max_path_length = 64;
+
+	uint64_t primary_rays = 0;
+	uint64_t secondary_rays = 0;
+	// Rays that hit something, and rays that escaped to the background.
+	uint64_t ray_hits = 0;
+	uint64_t ray_misses = 0;
+	// BVH nodes visited, both scene nodes and mesh nodes.
+	uint64_t node_visits = 0;
+	// Exact ray-sphere and ray-triangle tests, and how many of them hit.
+	// Sphere soups count their SIMD culls as block tests.
+	uint64_t sphere_tests = 0;
+	uint64_t sphere_hits = 0;
+	uint64_t soup_block_tests = 0;
+	uint64_t triangle_tests = 0;
+	uint64_t triangle_hits = 0;
+	// Scatter outcomes by material::kind.
+	uint64_t scattered[material::kind_count] = {};
+	uint64_t absorbed[material::kind_count] = {};
+	// Paths ended by Russian roulette and by the depth limit.
+	uint64_t roulette_ends = 0;
+	uint64_t depth_limit_ends = 0;
+	// Paths by the number of rays traced for them.
+	uint64_t path_lengths[max_path_length + 1] = {};
+
+	uint64_t rays() const { return primary_rays + secondary_rays; }
+	uint64_t paths() const;
+
+	render_counters& operator+=(const render_counters& other);
+	// What was counted between a snapshot and now.
+	render_counters operator-(const render_counters& earlier) const;
+};
+
+// The calling thread's counters. Zero-initialized per thread; never reset.
+inline thread_local render_counters thread_counters;
+
+// Small ids for threads, in order of first use, for traces.
+int render_thread_index();
+
+// Writes the counters as a JSON object, with rays per path and tests per
+// ray derived from them. indent prefixes every line after the first.
+void write_counters_json(std::ostream& out, const render_counters& counters, const char* indent = "");
+
+// RT_COUNT(field) bumps a render_counters field of the calling thread,
+// RT_COUNT_N(field, n) adds n to it and RT_COUNT_PATH(rays) records a
+// finished path that traced that many rays. They compile to nothing unless
+// the build defines RT_STATS.
+#ifdef RT_STATS
+#define RT_COUNT(field) (++thread_counters.field)
+#define RT_COUNT_N(field, n) (thread_counters.field += (n))
+#define RT_COUNT_PATH(rays) (++thread_counters.path_lengths[(rays) < render_counters::max_path_length ? (rays) : render_counters::max_path_length])
+#else
+#define RT_COUNT(field) ((void)0)
+#define RT_COUNT_N(field, n) ((void)0)
+#define RT_COUNT_PATH(rays) ((void)0)
+#endif
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "real.h"
+
 #include <cmath>
 #include <limits>
 #include <memory>
@@ -7,9 +9,12 @@
 using std::shared_ptr;
 using std::make_shared;
 using std::sqrt;
+using std::fabs;
+using std::fmin;
+using std::fmax;
 // Constants
-const double infinity = std::numeric_limits<double>::infinity();
-const double pi = 3.1415926535897932385;
+const real infinity = std::numeric_limits<real>::infinity();
+const real pi = static_cast<real>(3.1415926535897932385);
 // Utility Functions
 inline double degrees_to_radians(double degrees) {
 	return degrees * pi / 180.0;
@@ -30,17 +35,14 @@ inline double random_double(double min, double max) {
 	// Returns a random real in [min,max).
 	return min + (max - min) * random_double();
 }
-#include <random>
-#include <thread>
-// Thread-local mt19937 generator
-inline double threadsafe_random_double() {
-	static thread_local std::mt19937 generator(std::random_device{}() + std::hash<std::thread::id>{}(std::this_thread::get_id()));
-	static thread_local std::uniform_real_distribution<double> distribution(0.0, 1.0);
-	return distribution(generator);
+// Rendering code draws from a per-sample sampler instead of the shared rand() state,
+// which is left for scene construction.
+#include "sampler.h"
+inline real random_double(sampler& rng) {
+	return rng.next_real<real>();
 }
-inline double threadsafe_random_double(double min, double max) {
-	// Returns a random real in [min,max).
-	return min + (max - min) * threadsafe_random_double();
+inline real random_double(sampler& rng, real min, real max) {
+	return min + (max - min) * random_double(rng);
 }
 
 // Common Headers
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+
+// PCG32 generator (O'Neill, pcg-random.org) seeded from a pixel index and a
+// sample index. Every sample owns its random sequence, so a render is
+// bit-reproducible whatever the thread count or tile order.
+class sampler {
+public:
+	sampler(uint64_t pixel_index, uint64_t sample_index, uint64_t seed = 0) {
+		inc = (splitmix64(sample_index ^ seed) << 1u) | 1u;
+		state = splitmix64(pixel_index ^ splitmix64(sample_index + seed));
+		next_uint();
+	}
+	uint32_t next_uint() {
+		uint64_t oldstate = state;
+		state = oldstate * 6364136223846793005ULL + inc;
+		uint32_t xorshifted = static_cast<uint32_t>(((oldstate >> 18u) ^ oldstate) >> 27u);
+		uint32_t rot = static_cast<uint32_t>(oldstate >> 59u);
+		return (xorshifted >> rot) | (xorshifted << ((32u - rot) & 31u));
+	}
+	double next_double() {
+		// Returns a random real in [0,1).
+		return next_uint() * (1.0 / 4294967296.0);
+	}
+	double next_double(double min, double max) {
+		// Returns a random real in [min,max).
+		return min + (max - min) * next_double();
+	}
+	float next_float() {
+		// Returns a random real in [0,1). Uses 24 bits so it cannot round up to 1.
+		return (next_uint() >> 8) * (1.0f / 16777216.0f);
+	}
+	template <typename T> T next_real();
+private:
+	static uint64_t splitmix64(uint64_t x) {
+		x += 0x9E3779B97F4A7C15ULL;
+		x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+		return x ^ (x >> 31);
+	}
+	uint64_t state;
+	uint64_t inc;
+};
+
+template <> inline double sampler::next_real<double>() { return next_double(); }
+template <> inline float sampler::next_real<float>() { return next_float(); }
@@ -0,0 +1,22 @@
+#include "scene_arena.h"
+
+#include <cstdint>
+
+void* scene_arena::allocate(size_t size, size_t alignment)
+{
+	auto address = reinterpret_cast<uintptr_t>(cursor);
+	size_t padding = (alignment - address % alignment) % alignment;
+	if (cursor == nullptr || padding + size > static_cast<size_t>(limit - cursor)) {
+		// Objects bigger than a block get a block of their own.
+		size_t capacity = size + alignment > block_size ? size + alignment : block_size;
+		blocks.emplace_back(new unsigned char[capacity]);
+		cursor = blocks.back().get();
+		limit = cursor + capacity;
+		address = reinterpret_cast<uintptr_t>(cursor);
+		padding = (alignment - address % alignment) % alignment;
+	}
+	void* result = cursor + padding;
+	cursor += padding + size;
+	used += padding + size;
+	return result;
+}
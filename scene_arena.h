@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+using std::shared_ptr;
+
+// Bump allocator for scene objects. make<T>() places objects back to back in
+// large blocks, so building a scene of thousands of spheres costs a handful
+// of allocations instead of two per object.
+//
+// The returned shared_ptr owns its object like one from make_shared: the
+// control block sits next to the object in the arena, and the object is
+// destroyed when its last pointer goes. Every control block also holds a
+// reference to the arena, so the blocks are freed only once no object is
+// left in them. The arena has to be owned by a shared_ptr, as
+// hittable_list::arena() creates it; make() throws std::bad_weak_ptr otherwise.
+class scene_arena : public std::enable_shared_from_this<scene_arena> {
+public:
+	scene_arena() {}
+	scene_arena(const scene_arena&) = delete;
+	scene_arena& operator=(const scene_arena&) = delete;
+
+	template <typename T, typename... Args>
+	shared_ptr<T> make(Args&&... args) {
+		return std::allocate_shared<T>(allocator<T>(shared_from_this()), std::forward<Args>(args)...);
+	}
+
+	// Bytes handed out so far, including alignment padding.
+	size_t bytes_used() const { return used; }
+
+private:
+	// Hands out arena memory to allocate_shared. Freeing is a no-op; the
+	// memory goes back with the arena's blocks.
+	template <typename T>
+	struct allocator {
+		using value_type = T;
+		explicit allocator(shared_ptr<scene_arena> arena) : arena(std::move(arena)) {}
+		template <typename U>
+		allocator(const allocator<U>& other) : arena(other.arena) {}
+		T* allocate(size_t n) { return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T))); }
+		void deallocate(T*, size_t) {}
+		template <typename U>
+		bool operator==(const allocator<U>& other) const { return arena == other.arena; }
+		template <typename U>
+		bool operator!=(const allocator<U>& other) const { return arena != other.arena; }
+		shared_ptr<scene_arena> arena;
+	};
+
+	void* allocate(size_t size, size_t alignment);
+
+	static constexpr size_t block_size = 64 * 1024;
+	std::vector<std::unique_ptr<unsigned char[]>> blocks;
+	unsigned char* cursor = nullptr;
+	unsigned char* limit = nullptr;
+	size_t used = 0;
+};
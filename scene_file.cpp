@@ -0,0 +1,280 @@
+#include "scene_file.h"
+
+#include "bvh.h"
+#include "instance.h"
+#include "material.h"
+#include "obj_loader.h"
+#include "sphere.h"
+#include "sphere_soup.h"
+#include "triangle_mesh.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+	// Cursor over one line of the file.
+	class line_reader {
+	public:
+		line_reader(const char* text) : p(text) {}
+
+		bool at_end() {
+			skip_space();
+			return *p == '\0' || *p == '#';
+		}
+		// Copies the next whitespace separated word into out, reusing its storage.
+		bool word(std::string& out) {
+			skip_space();
+			const char* start = p;
+			while (*p != '\0' && *p != ' ' && *p != '\t' && *p != '\r' && *p != '#') ++p;
+			out.assign(start, p);
+			return p != start;
+		}
+		bool number(real& out) {
+			skip_space();
+			char* end = nullptr;
+			double value = std::strtod(p, &end);
+			if (end == p) return false;
+			p = end;
+			out = static_cast<real>(value);
+			return true;
+		}
+		bool vector(vec3& out) {
+			real x, y, z;
+			if (!number(x) || !number(y) || !number(z)) return false;
+			out = vec3(x, y, z);
+			return true;
+		}
+
+	private:
+		void skip_space() {
+			while (*p == ' ' || *p == '\t' || *p == '\r') ++p;
+		}
+		const char* p;
+	};
+}
+
+bool load_scene_file(const std::string& path, hittable_list& world, camera_settings& cam, std::string& error)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file) {
+		error = "cannot open " + path;
+		return false;
+	}
+
+	// Everything the file creates lives in the world's arena.
+	scene_arena& arena = world.arena();
+	std::unordered_map<std::string, shared_ptr<material>> materials;
+	std::unordered_map<std::string, shared_ptr<hittable>> groups;
+	// Objects go to the world, or to the group being defined.
+	hittable_list group_objects;
+	std::string group_name;
+	hittable_list* target = &world;
+	std::string line;
+	std::string keyword;
+	std::string name;
+	std::string kind;
+	int line_number = 0;
+
+	auto fail = [&](const std::string& message) {
+		error = path + ":" + std::to_string(line_number) + ": " + message;
+		return false;
+	};
+
+	while (std::getline(file, line)) {
+		++line_number;
+		line_reader in(line.c_str());
+		if (in.at_end()) continue;
+		in.word(keyword);
+
+		if (keyword == "sphere") {
+			vec3 center;
+			real radius;
+			if (!in.vector(center) || !in.number(radius) || !in.word(name))
+				return fail("expected: sphere <x y z> <radius> <material>");
+			auto found = materials.find(name);
+			if (found == materials.end())
+				return fail("unknown material '" + name + "'");
+			target->add(arena.make<sphere>(center, radius, found->second));
+		}
+		else if (keyword == "mesh") {
+			if (!in.word(kind) || !in.word(name))
+				return fail("expected: mesh <obj file> <material>");
+			auto found = materials.find(name);
+			if (found == materials.end())
+				return fail("unknown material '" + name + "'");
+			std::string mesh_path = kind;
+			bool absolute = mesh_path[0] == '/' || mesh_path[0] == '\\' || (mesh_path.size() > 1 && mesh_path[1] == ':');
+			size_t slash = path.find_last_of("/\\");
+			if (!absolute && slash != std::string::npos) mesh_path = path.substr(0, slash + 1) + mesh_path;
+			std::vector<point3> vertices;
+			std::vector<uint32_t> indices;
+			std::string mesh_error;
+			if (!load_obj(mesh_path, vertices, indices, mesh_error))
+				return fail(mesh_error);
+			if (indices.empty())
+				return fail(mesh_path + " has no faces");
+			target->add(arena.make<triangle_mesh>(std::move(vertices), std::move(indices), found->second));
+		}
+		else if (keyword == "group") {
+			if (target != &world) return fail("groups cannot be nested");
+			if (!in.word(group_name)) return fail("expected: group <name>");
+			group_objects.clear();
+			target = &group_objects;
+		}
+		else if (keyword == "end") {
+			if (target == &world) return fail("end without group");
+			if (group_objects.objects.empty()) return fail("group '" + group_name + "' is empty");
+			groups[group_name] = arena.make<bvh_node>(group_objects, sphere_soup::lane_width);
+			target = &world;
+		}
+		else if (keyword == "instance") {
+			if (!in.word(name)) return fail("expected: instance <group> <transforms>");
+			auto found = groups.find(name);
+			if (found == groups.end())
+				return fail("unknown group '" + name + "'");
+			transform placement;
+			while (!in.at_end()) {
+				vec3 v;
+				real value;
+				in.word(kind);
+				if (kind == "translate") {
+					if (!in.vector(v)) return fail("expected: translate <x y z>");
+					placement = transform::translate(v) * placement;
+				}
+				else if (kind == "rotate") {
+					if (!in.vector(v) || !in.number(value)) return fail("expected: rotate <axis x y z> <degrees>");
+					if (v.near_zero()) return fail("rotation axis is zero");
+					placement = transform::rotate(v, value) * placement;
+				}
+				else if (kind == "scale") {
+					if (!in.number(value)) return fail("expected: scale <s> or scale <x y z>");
+					real y, z;
+					if (in.number(y)) {
+						if (!in.number(z)) return fail("expected: scale <s> or scale <x y z>");
+						v = vec3(value, y, z);
+					}
+					else {
+						v = vec3(value, value, value);
+					}
+					if (v.x() == 0 || v.y() == 0 || v.z() == 0) return fail("scale factors must not be zero");
+					placement = transform::scale(v) * placement;
+				}
+				else {
+					return fail("unknown transform '" + kind + "'");
+				}
+			}
+			target->add(arena.make<instance>(found->second, placement));
+		}
+		else if (keyword == "material") {
+			if (!in.word(name) || !in.word(kind))
+				return fail("expected: material <name> <lambertian|metal|dielectric> ...");
+			shared_ptr<material> m;
+			vec3 albedo;
+			real value;
+			if (kind == "lambertian") {
+				if (!in.vector(albedo)) return fail("expected: material <name> lambertian <r g b>");
+				m = arena.make<lambertian>(albedo);
+			}
+			else if (kind == "metal") {
+				if (!in.vector(albedo) || !in.number(value)) return fail("expected: material <name> metal <r g b> <fuzz>");
+				m = arena.make<metal>(albedo, value);
+			}
+			else if (kind == "dielectric") {
+				if (!in.number(value)) return fail("expected: material <name> dielectric <index_of_refraction>");
+				m = arena.make<dielectric>(value);
+			}
+			else {
+				return fail("unknown material type '" + kind + "'");
+			}
+			materials[name] = m;
+		}
+		else if (keyword == "camera") {
+			camera_settings c;
+			if (!in.vector(c.lookfrom) || !in.vector(c.lookat) || !in.vector(c.vup)
+				|| !in.number(c.vfov) || !in.number(c.aperture) || !in.number(c.focus_dist))
+				return fail("expected: camera <lookfrom x y z> <lookat x y z> <vup x y z> <vfov> <aperture> <focus_dist>");
+			cam = c;
+		}
+		else {
+			return fail("unknown statement '" + keyword + "'");
+		}
+
+		if (!in.at_end())
+			return fail("unexpected text after " + keyword);
+	}
+	if (target != &world) {
+		++line_number;
+		return fail("group '" + group_name + "' is missing its end");
+	}
+	if (file.bad()) {
+		error = "error reading " + path;
+		return false;
+	}
+	return true;
+}
+
+bool save_scene_file(const std::string& path, const hittable_list& world, const camera_settings& cam, std::string& error)
+{
+	std::ofstream file(path);
+	if (!file) {
+		error = "cannot open " + path + " for writing";
+		return false;
+	}
+	file.precision(17);
+
+	auto write_vec = [&](const vec3& v) { file << v.x() << ' ' << v.y() << ' ' << v.z(); };
+	file << "camera ";
+	write_vec(cam.lookfrom);
+	file << "  ";
+	write_vec(cam.lookat);
+	file << "  ";
+	write_vec(cam.vup);
+	file << "  " << cam.vfov << ' ' << cam.aperture << ' ' << cam.focus_dist << "\n";
+
+	// Materials are named by the order they are first seen.
+	std::unordered_map<const material*, std::string> names;
+	int skipped = 0;
+	for (const auto& object : world.objects) {
+		auto s = std::dynamic_pointer_cast<sphere>(object);
+		if (!s) {
+			skipped++;
+			continue;
+		}
+		const material* m = s->mat_ptr.get();
+		auto found = names.find(m);
+		if (found == names.end()) {
+			std::string name = "m" + std::to_string(names.size());
+			file << "material " << name << ' ';
+			switch (m->type) {
+			case material::kind::lambertian:
+				file << "lambertian ";
+				write_vec(m->albedo);
+				break;
+			case material::kind::metal:
+				file << "metal ";
+				write_vec(m->albedo);
+				file << ' ' << m->fuzz;
+				break;
+			case material::kind::dielectric:
+				file << "dielectric " << m->ir;
+				break;
+			}
+			file << "\n";
+			found = names.emplace(m, name).first;
+		}
+		file << "sphere ";
+		write_vec(s->center);
+		file << ' ' << s->radius << ' ' << found->second << "\n";
+	}
+	if (skipped > 0)
+		std::cerr << "save_scene_file: skipped " << skipped << " objects that are not spheres.\n";
+	if (!file) {
+		error = "error writing " + path;
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "rtweekend.h"
+
+#include "hittable_list.h"
+
+#include <string>
+
+// Camera placement. Scene files may set it; the command line can override it.
+struct camera_settings {
+	point3 lookfrom = point3(13, 2, 3);
+	point3 lookat = point3(0, 0, 0);
+	vec3 vup = vec3(0, 1, 0);
+	real vfov = 20;
+	real aperture = real(0.6);
+	real focus_dist = 10;
+};
+
+// Text scene description, one statement per line:
+//
+//   # comments run to the end of the line
+//   camera <lookfrom x y z> <lookat x y z> <vup x y z> <vfov> <aperture> <focus_dist>
+//   material <name> lambertian <r g b>
+//   material <name> metal <r g b> <fuzz>
+//   material <name> dielectric <index_of_refraction>
+//   sphere <center x y z> <radius> <material name>
+//   mesh <obj file> <material name>
+//   group <name>
+//     ... objects ...
+//   end
+//   instance <group name> [translate <x y z>] [rotate <axis x y z> <degrees>] [scale <s> | <x y z>] ...
+//
+// Materials must be defined before the objects that use them. Mesh paths
+// are relative to the scene file. Objects
+// between group and end are built into one BVH that every instance of the
+// group shares; an instance's transforms apply in the order written. The file is
+// read line by line into reused buffers, so loading stays linear in its size.
+// Returns false with a message naming the line on a parse error.
+bool load_scene_file(const std::string& path, hittable_list& world, camera_settings& cam, std::string& error);
+
+// Writes the spheres of world and their materials in the format above.
+// Objects of other types are skipped with a warning.
+bool save_scene_file(const std::string& path, const hittable_list& world, const camera_settings& cam, std::string& error);
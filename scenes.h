@@ -0,0 +1,170 @@
+#pragma once
+
+#include "rtweekend.h"
+
+#include "hittable_list.h"
+#include "sphere.h"
+#include "material.h"
+#include "bvh.h"
+#include "instance.h"
+
+inline hittable_list book_scene() {
+	hittable_list world;
+	scene_arena& arena = world.arena();
+	auto ground_material = arena.make<lambertian>(color(0.5, 0.5, 0.5));
+	world.add(arena.make<sphere>(point3(0, -1000, 0), 1000, ground_material));
+	for (int a = -11; a < 11; a++) {
+		for (int b = -11; b < 11; b++) {
+			auto choose_mat = random_double();
+			point3 center(a + 0.9 * random_double(), 0.2, b + 0.9 * random_double());
+			if ((center - point3(4, 0.2, 0)).length() > 0.9) {
+				shared_ptr<material> sphere_material;
+				if (choose_mat < 0.8) {
+					// diffuse
+					auto albedo = random_vec3() * random_vec3();
+					sphere_material = arena.make<lambertian>(albedo);
+					world.add(arena.make<sphere>(center, 0.2, sphere_material));
+				}
+				else if (choose_mat < 0.95) {
+					// metal
+					auto albedo = random_vec3(0.5, 1);
+					auto fuzz = random_double(0, 0.5);
+					sphere_material = arena.make<metal>(albedo, fuzz);
+					world.add(arena.make<sphere>(center, 0.2, sphere_material));
+				}
+				else {
+					// glass
+					sphere_material = arena.make<dielectric>(1.5);
+					world.add(arena.make<sphere>(center, 0.2, sphere_material));
+				}
+			}
+		}
+	}
+	auto material1 = arena.make<dielectric>(1.5);
+	world.add(arena.make<sphere>(point3(0, 1, 0), 1.0, material1));
+	auto material2 = arena.make<lambertian>(color(0.4, 0.2, 0.1));
+	world.add(arena.make<sphere>(point3(-4, 1, 0), 1.0, material2));
+	auto material3 = arena.make<metal>(color(0.7, 0.6, 0.5), 0.0);
+	world.add(arena.make<sphere>(point3(4, 1, 0), 1.0, material3));
+	return world;
+}
+
+inline hittable_list random_scene() {
+	hittable_list world;
+	scene_arena& arena = world.arena();
+	auto ground_material = arena.make<lambertian>(color(0.5, 0.5, 0.5));
+	world.add(arena.make<sphere>(point3(0, -1000, 0), 1000, ground_material));
+
+	double xPosRange = 7.0;
+	double zPosRange = 4.0;
+
+	for (int i = 0; i < 500; i++) {
+		point3 center;
+		double choose_mat = random_double();
+
+		do {
+			double xOffset = (random_double() * 2.0) - 1.0;
+			double zOffset = (random_double() * 2.0) - 1.0;
+			double xPos = xOffset * xPosRange;
+			double zPos = zOffset * zPosRange;
+
+			center = point3(xPos, 0.2, zPos);
+		} while ((center - point3(4, 0.2, 0)).length() < 0.9);
+
+		shared_ptr<material> sphere_material;
+		if (choose_mat < 0.8) {
+			// diffuse
+			auto albedo = random_vec3() * random_vec3();
+			sphere_material = arena.make<lambertian>(albedo);
+			world.add(arena.make<sphere>(center, 0.2, sphere_material));
+		}
+		else if (choose_mat < 0.95) {
+			// metal
+			auto albedo = random_vec3(0.5, 1);
+			auto fuzz = random_double(0, 0.5);
+			sphere_material = arena.make<metal>(albedo, fuzz);
+			world.add(arena.make<sphere>(center, 0.2, sphere_material));
+		}
+		else {
+			// glass
+			sphere_material = arena.make<dielectric>(1.5);
+			world.add(arena.make<sphere>(center, 0.2, sphere_material));
+		}
+	}
+
+	auto material1 = arena.make<dielectric>(1.5);
+	world.add(arena.make<sphere>(point3(-4, 1, 0), 1.0, material1));
+	auto material2 = arena.make<lambertian>(color(0.4, 0.2, 0.1));
+	world.add(arena.make<sphere>(point3(-6, 1, 0), 1.0, material2));
+	auto material3 = arena.make<metal>(color(0.7, 0.6, 0.5), 0.0);
+	world.add(arena.make<sphere>(point3(0, 1, 0), 1.0, material3));
+	auto material4 = arena.make<metal>(color(0.8, 0.8, 0.8), 0.0);
+	world.add(arena.make<sphere>(point3(4, 1, 0), 1.0, material4));
+	return world;
+}
+
+inline hittable_list random_stacked_balls() {
+	hittable_list world;
+	scene_arena& arena = world.arena();
+	auto ground_material = arena.make<lambertian>(color(0.5, 0.5, 0.5));
+	world.add(arena.make<sphere>(point3(0, -1000, 0), 1000, ground_material));
+
+	for (int i = 0; i < 10; i++) {
+		point3 center = point3(0.0, 0.1 + (0.2 * i), 0.0);
+		double choose_mat = random_double();
+
+		shared_ptr<material> sphere_material;
+		if (choose_mat < 0.8) {
+			// diffuse
+			auto albedo = random_vec3() * random_vec3();
+			sphere_material = arena.make<lambertian>(albedo);
+			world.add(arena.make<sphere>(center, 0.1, sphere_material));
+		}
+		else if (choose_mat < 0.95) {
+			// metal
+			auto albedo = random_vec3(0.5, 1);
+			auto fuzz = random_double(0, 0.5);
+			sphere_material = arena.make<metal>(albedo, fuzz);
+			world.add(arena.make<sphere>(center, 0.1, sphere_material));
+		}
+		else {
+			// glass
+			sphere_material = arena.make<dielectric>(1.5);
+			world.add(arena.make<sphere>(center, 0.1, sphere_material));
+		}
+	}
+
+	return world;
+}
+
+// A small asset of nine spheres, built once into its own BVH and placed a
+// thousand times by instances with random turns and sizes. Put the result
+// in a bvh_node for a two-level hierarchy.
+inline hittable_list instanced_scene() {
+	hittable_list world;
+	scene_arena& arena = world.arena();
+	auto ground_material = arena.make<lambertian>(color(0.5, 0.5, 0.5));
+	world.add(arena.make<sphere>(point3(0, -1000, 0), 1000, ground_material));
+
+	hittable_list asset;
+	auto core = arena.make<metal>(color(0.8, 0.6, 0.2), 0.1);
+	auto shell = arena.make<lambertian>(color(0.2, 0.3, 0.7));
+	asset.add(arena.make<sphere>(point3(0, 0.2, 0), 0.12, core));
+	for (int i = 0; i < 8; i++) {
+		double angle = 2 * pi * i / 8;
+		asset.add(arena.make<sphere>(point3(0.2 * std::cos(angle), 0.05 + 0.05 * (i % 2), 0.2 * std::sin(angle)), 0.05, shell));
+	}
+	auto shared_asset = arena.make<bvh_node>(asset);
+
+	for (int i = 0; i < 1000; i++) {
+		point3 position(random_double(-7, 7), 0, random_double(-4, 4));
+		transform placement = transform::translate(position)
+			* transform::rotate(vec3(0, 1, 0), random_double(0, 360))
+			* transform::scale(random_double(0.6, 1.2));
+		world.add(arena.make<instance>(shared_asset, placement));
+	}
+
+	auto glass = arena.make<dielectric>(1.5);
+	world.add(arena.make<sphere>(point3(0, 1, 0), 1.0, glass));
+	return world;
+}
@@ -1,20 +1,23 @@
 #pragma once
 
 #include "hittable.h"
+#include "render_stats.h"
 
 class sphere : public hittable 
 {
 public:
 	sphere() {}
-	sphere(point3 cen, double r, shared_ptr<material> m) : center(cen), radius(r), mat_ptr(m) {};
+	sphere(point3 cen, real r, shared_ptr<material> m) : center(cen), radius(r), mat_ptr(m) {};
 	virtual bool hit(
-		const ray& r, double t_min, double t_max, hit_record& rec) const override;
+		const ray& r, real t_min, real t_max, hit_record& rec) const override;
+	virtual bool bounding_box(aabb& output_box) const override;
 public:
 	point3 center;
-	double radius;
+	real radius;
 	shared_ptr<material> mat_ptr;
 };
-inline bool sphere::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+inline bool sphere::hit(const ray& r, real t_min, real t_max, hit_record& rec) const {
+	RT_COUNT(sphere_tests);
 	vec3 oc = r.origin() - center;
 	auto a = r.direction().length_squared();
 	auto half_b = dot(oc, r.direction());
@@ -33,8 +36,12 @@ inline bool sphere::hit(const ray& r, double t_min, double t_max, hit_record& re
 	rec.p = r.at(rec.t); 
 	vec3 outward_normal = (rec.p - center) / radius;
 	rec.set_face_normal(r, outward_normal);
-	rec.mat_ptr = mat_ptr;
+	rec.mat_ptr = mat_ptr.get();
+	RT_COUNT(sphere_hits);
+	return true;
+}
+inline bool sphere::bounding_box(aabb& output_box) const {
+	vec3 extent(fabs(radius), fabs(radius), fabs(radius));
+	output_box = aabb(center - extent, center + extent);
 	return true;
 }
-
-
@@ -0,0 +1,189 @@
+#include "sphere_soup.h"
+
+#if defined(__AVX__) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+#endif
+
+namespace {
+	// The cull works in float, so it accepts anything within a relative
+	// tolerance of a hit and leaves the exact answer to the full precision test.
+	const float cull_discriminant_tolerance = 1e-5f;
+	const float cull_t_tolerance = 1e-3f;
+	const size_t soup_padding = 8;
+}
+
+void sphere_soup::add(const point3& center, real r, uint32_t id)
+{
+	size_t padded = ((count + 1 + soup_padding - 1) / soup_padding) * soup_padding;
+	center_x.resize(padded, 0.0f);
+	center_y.resize(padded, 0.0f);
+	center_z.resize(padded, 0.0f);
+	radius.resize(padded, 0.0f);
+	material_id.resize(padded, 0);
+
+	center_x[count] = static_cast<float>(center.x());
+	center_y[count] = static_cast<float>(center.y());
+	center_z[count] = static_cast<float>(center.z());
+	radius[count] = static_cast<float>(r);
+	material_id[count] = id;
+	exact.push_back({ center, r });
+	count++;
+
+	vec3 extent(fabs(r), fabs(r), fabs(r));
+	bounds.expand(aabb(center - extent, center + extent));
+}
+
+bool sphere_soup::bounding_box(aabb& output_box) const
+{
+	output_box = bounds;
+	return count > 0;
+}
+
+bool sphere_soup::hit(const ray& r, real t_min, real t_max, hit_record& rec) const
+{
+	const float origin[3] = { static_cast<float>(r.orig[0]), static_cast<float>(r.orig[1]), static_cast<float>(r.orig[2]) };
+	const float direction[3] = { static_cast<float>(r.dir[0]), static_cast<float>(r.dir[1]), static_cast<float>(r.dir[2]) };
+	const float inv_a = 1.0f / (direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2]);
+
+	bool hit_anything = false;
+	for (size_t base = 0; base < count; base += lane_width) {
+		RT_COUNT(soup_block_tests);
+		unsigned int candidates = cull_block(origin, direction, inv_a, base,
+			static_cast<float>(t_min), static_cast<float>(t_max));
+		// Drop the padding lanes past the last sphere.
+		size_t remaining = count - base;
+		if (remaining < static_cast<size_t>(lane_width)) candidates &= (1u << remaining) - 1u;
+
+		for (int lane = 0; candidates != 0; lane++, candidates >>= 1) {
+			if ((candidates & 1u) && hit_sphere(base + lane, r, t_min, t_max, rec)) {
+				hit_anything = true;
+				t_max = rec.t;
+			}
+		}
+	}
+	return hit_anything;
+}
+
+bool sphere_soup::hit_sphere(size_t i, const ray& r, real t_min, real t_max, hit_record& rec) const
+{
+	RT_COUNT(sphere_tests);
+	const point3& center = exact[i].center;
+	const real rad = exact[i].radius;
+	vec3 oc = r.origin() - center;
+	auto a = r.direction().length_squared();
+	auto half_b = dot(oc, r.direction());
+	auto c = oc.length_squared() - rad * rad;
+	auto discriminant = half_b * half_b - a * c;
+	if (discriminant < 0) return false;
+	auto sqrtd = sqrt(discriminant);
+	// Find the nearest root that lies in the acceptable range.
+	auto root = (-half_b - sqrtd) / a;
+	if (root < t_min || t_max < root) {
+		root = (-half_b + sqrtd) / a;
+		if (root < t_min || t_max < root)
+			return false;
+	}
+	rec.t = root;
+	rec.p = r.at(rec.t);
+	vec3 outward_normal = (rec.p - center) / rad;
+	rec.set_face_normal(r, outward_normal);
+	rec.mat_ptr = &(*materials)[material_id[i]];
+	RT_COUNT(sphere_hits);
+	return true;
+}
+
+#if defined(__AVX__)
+
+unsigned int sphere_soup::cull_block(const float origin[3], const float direction[3], float inv_a,
+	size_t base, float t_min, float t_max) const
+{
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 dx = _mm256_set1_ps(direction[0]);
+	const __m256 dy = _mm256_set1_ps(direction[1]);
+	const __m256 dz = _mm256_set1_ps(direction[2]);
+	const __m256 a = _mm256_set1_ps(1.0f / inv_a);
+	const __m256 ia = _mm256_set1_ps(inv_a);
+
+	// oc points from the ray origin to the centers, so the near root is (b - sqrt(disc)) / a.
+	__m256 ocx = _mm256_sub_ps(_mm256_loadu_ps(&center_x[base]), _mm256_set1_ps(origin[0]));
+	__m256 ocy = _mm256_sub_ps(_mm256_loadu_ps(&center_y[base]), _mm256_set1_ps(origin[1]));
+	__m256 ocz = _mm256_sub_ps(_mm256_loadu_ps(&center_z[base]), _mm256_set1_ps(origin[2]));
+	__m256 rad = _mm256_loadu_ps(&radius[base]);
+
+	__m256 b = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocx, dx), _mm256_mul_ps(ocy, dy)), _mm256_mul_ps(ocz, dz));
+	__m256 oc2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocx, ocx), _mm256_mul_ps(ocy, ocy)), _mm256_mul_ps(ocz, ocz));
+	__m256 c = _mm256_sub_ps(oc2, _mm256_mul_ps(rad, rad));
+	__m256 b2 = _mm256_mul_ps(b, b);
+	__m256 disc = _mm256_sub_ps(b2, _mm256_mul_ps(a, c));
+	__m256 tolerance = _mm256_mul_ps(_mm256_set1_ps(cull_discriminant_tolerance), _mm256_add_ps(b2, _mm256_mul_ps(a, oc2)));
+
+	__m256 sq = _mm256_sqrt_ps(_mm256_max_ps(disc, zero));
+	__m256 t_near = _mm256_mul_ps(_mm256_sub_ps(b, sq), ia);
+	__m256 t_far = _mm256_mul_ps(_mm256_add_ps(b, sq), ia);
+	__m256 abs_b = _mm256_max_ps(b, _mm256_sub_ps(zero, b));
+	__m256 slack = _mm256_add_ps(_mm256_set1_ps(cull_t_tolerance), _mm256_mul_ps(_mm256_set1_ps(cull_t_tolerance), _mm256_mul_ps(abs_b, ia)));
+
+	__m256 mask = _mm256_cmp_ps(disc, _mm256_sub_ps(zero, tolerance), _CMP_GE_OQ);
+	mask = _mm256_and_ps(mask, _mm256_cmp_ps(t_near, _mm256_add_ps(_mm256_set1_ps(t_max), slack), _CMP_LE_OQ));
+	mask = _mm256_and_ps(mask, _mm256_cmp_ps(t_far, _mm256_sub_ps(_mm256_set1_ps(t_min), slack), _CMP_GE_OQ));
+	return static_cast<unsigned int>(_mm256_movemask_ps(mask));
+}
+
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+
+unsigned int sphere_soup::cull_block(const float origin[3], const float direction[3], float inv_a,
+	size_t base, float t_min, float t_max) const
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 dx = _mm_set1_ps(direction[0]);
+	const __m128 dy = _mm_set1_ps(direction[1]);
+	const __m128 dz = _mm_set1_ps(direction[2]);
+	const __m128 a = _mm_set1_ps(1.0f / inv_a);
+	const __m128 ia = _mm_set1_ps(inv_a);
+
+	// oc points from the ray origin to the centers, so the near root is (b - sqrt(disc)) / a.
+	__m128 ocx = _mm_sub_ps(_mm_loadu_ps(&center_x[base]), _mm_set1_ps(origin[0]));
+	__m128 ocy = _mm_sub_ps(_mm_loadu_ps(&center_y[base]), _mm_set1_ps(origin[1]));
+	__m128 ocz = _mm_sub_ps(_mm_loadu_ps(&center_z[base]), _mm_set1_ps(origin[2]));
+	__m128 rad = _mm_loadu_ps(&radius[base]);
+
+	__m128 b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, dx), _mm_mul_ps(ocy, dy)), _mm_mul_ps(ocz, dz));
+	__m128 oc2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, ocx), _mm_mul_ps(ocy, ocy)), _mm_mul_ps(ocz, ocz));
+	__m128 c = _mm_sub_ps(oc2, _mm_mul_ps(rad, rad));
+	__m128 b2 = _mm_mul_ps(b, b);
+	__m128 disc = _mm_sub_ps(b2, _mm_mul_ps(a, c));
+	__m128 tolerance = _mm_mul_ps(_mm_set1_ps(cull_discriminant_tolerance), _mm_add_ps(b2, _mm_mul_ps(a, oc2)));
+
+	__m128 sq = _mm_sqrt_ps(_mm_max_ps(disc, zero));
+	__m128 t_near = _mm_mul_ps(_mm_sub_ps(b, sq), ia);
+	__m128 t_far = _mm_mul_ps(_mm_add_ps(b, sq), ia);
+	__m128 abs_b = _mm_max_ps(b, _mm_sub_ps(zero, b));
+	__m128 slack = _mm_add_ps(_mm_set1_ps(cull_t_tolerance), _mm_mul_ps(_mm_set1_ps(cull_t_tolerance), _mm_mul_ps(abs_b, ia)));
+
+	__m128 mask = _mm_cmpge_ps(disc, _mm_sub_ps(zero, tolerance));
+	mask = _mm_and_ps(mask, _mm_cmple_ps(t_near, _mm_add_ps(_mm_set1_ps(t_max), slack)));
+	mask = _mm_and_ps(mask, _mm_cmpge_ps(t_far, _mm_sub_ps(_mm_set1_ps(t_min), slack)));
+	return static_cast<unsigned int>(_mm_movemask_ps(mask));
+}
+
+#else
+
+unsigned int sphere_soup::cull_block(const float origin[3], const float direction[3], float inv_a,
+	size_t base, float t_min, float t_max) const
+{
+	float a = 1.0f / inv_a;
+	float ocx = center_x[base] - origin[0];
+	float ocy = center_y[base] - origin[1];
+	float ocz = center_z[base] - origin[2];
+	float b = ocx * direction[0] + ocy * direction[1] + ocz * direction[2];
+	float oc2 = ocx * ocx + ocy * ocy + ocz * ocz;
+	float disc = b * b - a * (oc2 - radius[base] * radius[base]);
+	if (disc < -cull_discriminant_tolerance * (b * b + a * oc2)) return 0;
+	float sq = std::sqrt(disc > 0.0f ? disc : 0.0f);
+	float slack = cull_t_tolerance * (1.0f + std::fabs(b) * inv_a);
+	if ((b - sq) * inv_a > t_max + slack) return 0;
+	if ((b + sq) * inv_a < t_min - slack) return 0;
+	return 1;
+}
+
+#endif
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "hittable.h"
+#include "material.h"
+#include "render_stats.h"
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Spheres stored as structure-of-arrays floats. A SIMD kernel (AVX, SSE2 or
+// scalar, picked at compile time) culls a whole block of spheres per ray in
+// a few instructions; the surviving candidates, usually none or one, are then
+// intersected exactly against the spheres as given, at the build's
+// precision, so results match sphere::hit. Negative radii keep the inward
+// normals of hollow spheres. Works standalone or as a bvh_node leaf.
+class sphere_soup : public hittable {
+public:
+#if defined(__AVX__)
+	static constexpr int lane_width = 8;
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	static constexpr int lane_width = 4;
+#else
+	static constexpr int lane_width = 1;
+#endif
+
+	// material_ids passed to add() index this table, which the soup shares.
+	explicit sphere_soup(shared_ptr<const material_table> materials) : materials(std::move(materials)) {}
+	void add(const point3& center, real radius, uint32_t material_id);
+	size_t size() const { return count; }
+	virtual bool hit(
+		const ray& r, real t_min, real t_max, hit_record& rec) const override;
+	virtual bool bounding_box(aabb& output_box) const override;
+public:
+	// Padded to a multiple of 8 so every block load is in bounds.
+	std::vector<float> center_x;
+	std::vector<float> center_y;
+	std::vector<float> center_z;
+	// Signed, as given; the cull only uses its square.
+	std::vector<float> radius;
+	std::vector<uint32_t> material_id;
+	shared_ptr<const material_table> materials;
+
+private:
+	// Bit i is set if sphere base + i might be hit within [t_min, t_max].
+	unsigned int cull_block(const float origin[3], const float direction[3], float inv_a,
+		size_t base, float t_min, float t_max) const;
+	bool hit_sphere(size_t i, const ray& r, real t_min, real t_max, hit_record& rec) const;
+
+	// The spheres unrounded, for the exact test of the culled candidates.
+	struct exact_sphere {
+		point3 center;
+		real radius;
+	};
+	std::vector<exact_sphere> exact;
+	size_t count = 0;
+	aabb bounds;
+};
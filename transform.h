@@ -0,0 +1,120 @@
+#pragma once
+
+#include "rtweekend.h"
+#include "aabb.h"
+
+#include <cmath>
+
+// Affine object-to-world map, kept together with its inverse so neither has
+// to be computed by inverting a matrix. Built from translations, rotations
+// and scales and composed with operator*.
+class transform {
+public:
+	transform() : forward(identity()), inverse(identity()) {}
+
+	static transform translate(const vec3& offset) {
+		transform t;
+		for (int i = 0; i < 3; i++) {
+			t.forward.m[i][3] = offset[i];
+			t.inverse.m[i][3] = -offset[i];
+		}
+		return t;
+	}
+	// Rotation by degrees about axis, counterclockwise looking down the axis.
+	static transform rotate(const vec3& axis, real degrees) {
+		vec3 a = unit_vector(axis);
+		real theta = static_cast<real>(degrees_to_radians(degrees));
+		real c = std::cos(theta);
+		real s = std::sin(theta);
+		real k = 1 - c;
+		const real r[3][3] = {
+			{ c + a.x() * a.x() * k, a.x() * a.y() * k - a.z() * s, a.x() * a.z() * k + a.y() * s },
+			{ a.y() * a.x() * k + a.z() * s, c + a.y() * a.y() * k, a.y() * a.z() * k - a.x() * s },
+			{ a.z() * a.x() * k - a.y() * s, a.z() * a.y() * k + a.x() * s, c + a.z() * a.z() * k },
+		};
+		// A rotation's inverse is its transpose.
+		transform t;
+		for (int i = 0; i < 3; i++) {
+			for (int j = 0; j < 3; j++) {
+				t.forward.m[i][j] = r[i][j];
+				t.inverse.m[i][j] = r[j][i];
+			}
+		}
+		return t;
+	}
+	static transform scale(const vec3& factors) {
+		transform t;
+		for (int i = 0; i < 3; i++) {
+			t.forward.m[i][i] = factors[i];
+			t.inverse.m[i][i] = 1 / factors[i];
+		}
+		return t;
+	}
+	static transform scale(real factor) { return scale(vec3(factor, factor, factor)); }
+
+	// Applies rhs first, then this.
+	transform operator*(const transform& rhs) const {
+		transform t;
+		t.forward = multiply(forward, rhs.forward);
+		t.inverse = multiply(rhs.inverse, inverse);
+		return t;
+	}
+
+	point3 point(const point3& p) const { return apply(forward, p, 1); }
+	vec3 vector(const vec3& v) const { return apply(forward, v, 0); }
+	// Normals go through the inverse transpose. Not normalized.
+	vec3 normal(const vec3& n) const {
+		const auto& m = inverse.m;
+		return vec3(
+			m[0][0] * n.x() + m[1][0] * n.y() + m[2][0] * n.z(),
+			m[0][1] * n.x() + m[1][1] * n.y() + m[2][1] * n.z(),
+			m[0][2] * n.x() + m[1][2] * n.y() + m[2][2] * n.z());
+	}
+	point3 inverse_point(const point3& p) const { return apply(inverse, p, 1); }
+	vec3 inverse_vector(const vec3& v) const { return apply(inverse, v, 0); }
+
+	// Bounds of the transformed corners of box.
+	aabb box(const aabb& object_box) const {
+		aabb world_box;
+		for (int corner = 0; corner < 8; corner++) {
+			point3 p(
+				(corner & 1) ? object_box.max().x() : object_box.min().x(),
+				(corner & 2) ? object_box.max().y() : object_box.min().y(),
+				(corner & 4) ? object_box.max().z() : object_box.min().z());
+			world_box.expand(point(p));
+		}
+		return world_box;
+	}
+
+private:
+	// Rows of a 3x4 affine matrix; the implied last row is 0 0 0 1.
+	struct matrix {
+		real m[3][4];
+	};
+
+	static matrix identity() {
+		matrix r = {};
+		r.m[0][0] = r.m[1][1] = r.m[2][2] = 1;
+		return r;
+	}
+	static matrix multiply(const matrix& a, const matrix& b) {
+		matrix r;
+		for (int i = 0; i < 3; i++) {
+			for (int j = 0; j < 4; j++) {
+				r.m[i][j] = a.m[i][0] * b.m[0][j] + a.m[i][1] * b.m[1][j] + a.m[i][2] * b.m[2][j];
+				if (j == 3) r.m[i][j] += a.m[i][3];
+			}
+		}
+		return r;
+	}
+	// w is 1 for points and 0 for vectors.
+	static vec3 apply(const matrix& a, const vec3& v, real w) {
+		return vec3(
+			a.m[0][0] * v.x() + a.m[0][1] * v.y() + a.m[0][2] * v.z() + a.m[0][3] * w,
+			a.m[1][0] * v.x() + a.m[1][1] * v.y() + a.m[1][2] * v.z() + a.m[1][3] * w,
+			a.m[2][0] * v.x() + a.m[2][1] * v.y() + a.m[2][2] * v.z() + a.m[2][3] * w);
+	}
+
+	matrix forward;
+	matrix inverse;
+};
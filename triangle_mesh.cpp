@@ -0,0 +1,265 @@
+#include "triangle_mesh.h"
+
+#include "render_stats.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+	const int mesh_bucket_count = 16;
+	const uint32_t mesh_max_leaf_size = 4;
+	// Relative cost of a box test against a triangle test, for the SAH.
+	const real mesh_traversal_cost = real(0.5);
+	// Below this depth ranges are split at the median, which bounds the
+	// tree depth and with it the traversal stack.
+	const int mesh_sah_depth_limit = 48;
+	const int mesh_stack_size = 128;
+
+	// Per-ray constants of the watertight test: the axis the direction is
+	// largest along becomes z, and the shear maps the direction onto +z.
+	struct woop_ray {
+		int kx, ky, kz;
+		real sx, sy, sz;
+
+		woop_ray(const vec3& dir) {
+			kz = 0;
+			if (fabs(dir[1]) > fabs(dir[kz])) kz = 1;
+			if (fabs(dir[2]) > fabs(dir[kz])) kz = 2;
+			kx = (kz + 1) % 3;
+			ky = (kx + 1) % 3;
+			// Keep the winding of the triangle.
+			if (dir[kz] < 0) std::swap(kx, ky);
+			sx = dir[kx] / dir[kz];
+			sy = dir[ky] / dir[kz];
+			sz = 1 / dir[kz];
+		}
+	};
+
+	// Returns the hit distance in (t_min, t_max), or 0 for a miss.
+	inline real intersect_triangle(const woop_ray& w, const point3& origin,
+		const point3& p0, const point3& p1, const point3& p2, real t_min, real t_max) {
+		const vec3 a = p0 - origin;
+		const vec3 b = p1 - origin;
+		const vec3 c = p2 - origin;
+		const real ax = a[w.kx] - w.sx * a[w.kz];
+		const real ay = a[w.ky] - w.sy * a[w.kz];
+		const real bx = b[w.kx] - w.sx * b[w.kz];
+		const real by = b[w.ky] - w.sy * b[w.kz];
+		const real cx = c[w.kx] - w.sx * c[w.kz];
+		const real cy = c[w.ky] - w.sy * c[w.kz];
+
+		real u = cx * by - cy * bx;
+		real v = ax * cy - ay * cx;
+		real e = bx * ay - by * ax;
+		// Single precision loses edge hits to rounding; redo them in double.
+		if (sizeof(real) < sizeof(double) && (u == 0 || v == 0 || e == 0)) {
+			u = static_cast<real>(static_cast<double>(cx) * by - static_cast<double>(cy) * bx);
+			v = static_cast<real>(static_cast<double>(ax) * cy - static_cast<double>(ay) * cx);
+			e = static_cast<real>(static_cast<double>(bx) * ay - static_cast<double>(by) * ax);
+		}
+		if ((u < 0 || v < 0 || e < 0) && (u > 0 || v > 0 || e > 0)) return 0;
+		const real det = u + v + e;
+		if (det == 0) return 0;
+
+		const real t = (u * w.sz * a[w.kz] + v * w.sz * b[w.kz] + e * w.sz * c[w.kz]) / det;
+		return (t > t_min && t < t_max) ? t : 0;
+	}
+
+	inline bool hit_box(const aabb& box, const point3& origin, const vec3& inv_dir, real t_min, real t_max) {
+		for (int a = 0; a < 3; a++) {
+			real t0 = (box.minimum[a] - origin[a]) * inv_dir[a];
+			real t1 = (box.maximum[a] - origin[a]) * inv_dir[a];
+			if (inv_dir[a] < 0) std::swap(t0, t1);
+			t_min = t0 > t_min ? t0 : t_min;
+			t_max = t1 < t_max ? t1 : t_max;
+			if (t_max < t_min) return false;
+		}
+		return true;
+	}
+}
+
+// The centroid is recomputed from the box when needed, which is cheaper
+// than the memory traffic of storing it for millions of triangles.
+struct mesh_primitive {
+	aabb box;
+	uint32_t triangle;
+
+	real centroid(int axis) const { return real(0.5) * (box.minimum[axis] + box.maximum[axis]); }
+};
+
+triangle_mesh::triangle_mesh(std::vector<point3> vertices, std::vector<uint32_t> indices, shared_ptr<material> m)
+	: vertices(std::move(vertices)), indices(std::move(indices)), mat_ptr(m)
+{
+	this->indices.resize(this->indices.size() / 3 * 3);
+	const uint32_t count = static_cast<uint32_t>(triangle_count());
+	if (count == 0) return;
+
+	std::vector<mesh_primitive> primitives(count);
+	for (uint32_t i = 0; i < count; i++) {
+		mesh_primitive& p = primitives[i];
+		for (int k = 0; k < 3; k++) p.box.expand(this->vertices[this->indices[3 * i + k]]);
+		p.triangle = i;
+	}
+
+	nodes.reserve(2 * count / mesh_max_leaf_size + 1);
+	build(primitives, 0, count, 0);
+
+	// Store the triangles in leaf order.
+	std::vector<uint32_t> sorted(this->indices.size());
+	for (uint32_t i = 0; i < count; i++)
+		for (int k = 0; k < 3; k++) sorted[3 * i + k] = this->indices[3 * primitives[i].triangle + k];
+	this->indices.swap(sorted);
+}
+
+uint32_t triangle_mesh::build(std::vector<mesh_primitive>& primitives, uint32_t start, uint32_t end, int depth)
+{
+	const uint32_t index = static_cast<uint32_t>(nodes.size());
+	nodes.emplace_back();
+
+	aabb box;
+	aabb centroid_bounds;
+	for (uint32_t i = start; i < end; i++) {
+		box.expand(primitives[i].box);
+		centroid_bounds.expand(primitives[i].box.centroid());
+	}
+	nodes[index].box = box;
+	const uint32_t count = end - start;
+
+	// Binned SAH as in bvh_node, but only along the longest centroid axis
+	// (as pbrt does), since meshes have millions of triangles to bin, and
+	// with leaves of up to mesh_max_leaf_size triangles when splitting does
+	// not pay.
+	real best_cost = infinity;
+	int best_axis = -1;
+	int best_bucket = 0;
+	const int axis = centroid_bounds.longest_axis();
+	const real axis_min = centroid_bounds.minimum[axis];
+	const real extent = centroid_bounds.maximum[axis] - axis_min;
+	const real bucket_scale = extent > 0 ? mesh_bucket_count / extent : 0;
+	auto bucket_of = [&](const mesh_primitive& p) {
+		int b = static_cast<int>((p.centroid(axis) - axis_min) * bucket_scale);
+		return b < mesh_bucket_count ? b : mesh_bucket_count - 1;
+	};
+	if (count > 1 && depth < mesh_sah_depth_limit && extent > 0) {
+		int counts[mesh_bucket_count] = {};
+		aabb bounds[mesh_bucket_count];
+		for (uint32_t i = start; i < end; i++) {
+			int b = bucket_of(primitives[i]);
+			counts[b]++;
+			bounds[b].expand(primitives[i].box);
+		}
+
+		real right_area[mesh_bucket_count];
+		int right_count[mesh_bucket_count];
+		aabb accumulated;
+		int accumulated_count = 0;
+		for (int b = mesh_bucket_count - 1; b > 0; b--) {
+			accumulated.expand(bounds[b]);
+			accumulated_count += counts[b];
+			right_area[b] = accumulated.surface_area();
+			right_count[b] = accumulated_count;
+		}
+		accumulated = aabb();
+		accumulated_count = 0;
+		for (int b = 0; b < mesh_bucket_count - 1; b++) {
+			accumulated.expand(bounds[b]);
+			accumulated_count += counts[b];
+			if (accumulated_count == 0 || right_count[b + 1] == 0) continue;
+			real cost = accumulated.surface_area() * accumulated_count + right_area[b + 1] * right_count[b + 1];
+			if (cost < best_cost) {
+				best_cost = cost;
+				best_axis = axis;
+				best_bucket = b;
+			}
+		}
+	}
+
+	// Leaf cost against split cost, both relative to this node's area.
+	const real leaf_cost = static_cast<real>(count);
+	const real area = box.surface_area();
+	const bool split_pays = best_axis >= 0 && area > 0 && mesh_traversal_cost + best_cost / area < leaf_cost;
+	if (count <= mesh_max_leaf_size && !split_pays) {
+		nodes[index].offset = start;
+		nodes[index].count = static_cast<uint16_t>(count);
+		return index;
+	}
+
+	uint32_t mid = start;
+	if (best_axis >= 0) {
+		auto it = std::partition(primitives.begin() + start, primitives.begin() + end,
+			[&](const mesh_primitive& p) { return bucket_of(p) <= best_bucket; });
+		mid = static_cast<uint32_t>(it - primitives.begin());
+	}
+	if (mid == start || mid == end) {
+		// Coincident centroids or too deep: split the range in half.
+		mid = start + count / 2;
+		std::nth_element(primitives.begin() + start, primitives.begin() + mid, primitives.begin() + end,
+			[axis](const mesh_primitive& a, const mesh_primitive& b) { return a.centroid(axis) < b.centroid(axis); });
+	}
+
+	nodes[index].axis = static_cast<uint8_t>(axis);
+	build(primitives, start, mid, depth + 1);
+	uint32_t right = build(primitives, mid, end, depth + 1);
+	nodes[index].offset = right;
+	return index;
+}
+
+bool triangle_mesh::hit(const ray& r, real t_min, real t_max, hit_record& rec) const
+{
+	if (nodes.empty()) return false;
+
+	const woop_ray w(r.dir);
+	const vec3 inv_dir(1 / r.dir[0], 1 / r.dir[1], 1 / r.dir[2]);
+	uint32_t hit_triangle = 0;
+	bool hit_anything = false;
+
+	uint32_t stack[mesh_stack_size];
+	int stack_size = 0;
+	uint32_t current = 0;
+	while (true) {
+		const node& n = nodes[current];
+		RT_COUNT(node_visits);
+		if (hit_box(n.box, r.orig, inv_dir, t_min, t_max)) {
+			if (n.count > 0) {
+				for (uint32_t i = n.offset; i < n.offset + n.count; i++) {
+					const uint32_t* tri = &indices[3 * i];
+					RT_COUNT(triangle_tests);
+					real t = intersect_triangle(w, r.orig, vertices[tri[0]], vertices[tri[1]], vertices[tri[2]], t_min, t_max);
+					if (t > 0) {
+						RT_COUNT(triangle_hits);
+						t_max = t;
+						hit_triangle = i;
+						hit_anything = true;
+					}
+				}
+			}
+			else {
+				// Near child first; the far one waits on the stack.
+				uint32_t near_child = current + 1;
+				uint32_t far_child = n.offset;
+				if (r.dir[n.axis] < 0) std::swap(near_child, far_child);
+				stack[stack_size++] = far_child;
+				current = near_child;
+				continue;
+			}
+		}
+		if (stack_size == 0) break;
+		current = stack[--stack_size];
+	}
+	if (!hit_anything) return false;
+
+	const uint32_t* tri = &indices[3 * hit_triangle];
+	const point3& p0 = vertices[tri[0]];
+	rec.t = t_max;
+	rec.p = r.at(t_max);
+	rec.set_face_normal(r, unit_vector(cross(vertices[tri[1]] - p0, vertices[tri[2]] - p0)));
+	rec.mat_ptr = mat_ptr.get();
+	return true;
+}
+
+bool triangle_mesh::bounding_box(aabb& output_box) const
+{
+	if (nodes.empty()) return false;
+	output_box = nodes[0].box;
+	return true;
+}
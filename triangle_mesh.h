@@ -0,0 +1,42 @@
+#pragma once
+
+#include "hittable.h"
+
+#include <cstdint>
+#include <vector>
+
+struct mesh_primitive;
+
+// Indexed triangle mesh with its own flat BVH. Triangles are three indices
+// into the shared vertex buffer, wound counterclockwise seen from the front.
+// Intersection uses the watertight test of Woop, Benthin and Wald (JCGT
+// 2013), so rays cannot slip through the shared edges of neighbouring
+// triangles. Shading uses the geometric normal.
+class triangle_mesh : public hittable {
+public:
+	triangle_mesh(std::vector<point3> vertices, std::vector<uint32_t> indices, shared_ptr<material> m);
+
+	size_t triangle_count() const { return indices.size() / 3; }
+	virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override;
+	virtual bool bounding_box(aabb& output_box) const override;
+
+public:
+	std::vector<point3> vertices;
+	// Reordered by the BVH build so every leaf covers a contiguous range.
+	std::vector<uint32_t> indices;
+	shared_ptr<material> mat_ptr;
+
+private:
+	// Interior nodes keep their left child right after them and store the
+	// index of the right one; leaves store a triangle range.
+	struct node {
+		aabb box;
+		uint32_t offset = 0; // first triangle, or right child
+		uint16_t count = 0;  // triangles in a leaf, 0 for interior nodes
+		uint8_t axis = 0;
+	};
+
+	uint32_t build(std::vector<mesh_primitive>& primitives, uint32_t start, uint32_t end, int depth);
+
+	std::vector<node> nodes;
+};
@@ -0,0 +1,158 @@
+#include "wavefront.h"
+
+#include "material.h"
+#include "ray_packet.h"
+#include "render_stats.h"
+
+#include <algorithm>
+
+void wavefront_integrator::path_queue::clear()
+{
+	resize(0);
+}
+
+void wavefront_integrator::path_queue::resize(size_t n)
+{
+	ox.resize(n); oy.resize(n); oz.resize(n);
+	dx.resize(n); dy.resize(n); dz.resize(n);
+	tr.resize(n); tg.resize(n); tb.resize(n);
+	path.resize(n);
+}
+
+void wavefront_integrator::path_queue::push(const ray& r, const color& throughput, uint32_t id)
+{
+	ox.push_back(r.orig.x()); oy.push_back(r.orig.y()); oz.push_back(r.orig.z());
+	dx.push_back(r.dir.x()); dy.push_back(r.dir.y()); dz.push_back(r.dir.z());
+	tr.push_back(throughput.x()); tg.push_back(throughput.y()); tb.push_back(throughput.z());
+	path.push_back(id);
+}
+
+void wavefront_integrator::add_path(const ray& r, const sampler& rng)
+{
+	current.push(r, color(1.0, 1.0, 1.0), static_cast<uint32_t>(path_rng.size()));
+	path_rng.push_back(rng);
+}
+
+void wavefront_integrator::clear()
+{
+	current.clear();
+	path_rng.clear();
+	packet_starts.clear();
+}
+
+void wavefront_integrator::trace(const hittable& world, const integrator_settings& settings, bool use_packets)
+{
+	radiance.assign(path_rng.size(), color(0, 0, 0));
+	for (int bounce = 0; bounce < settings.max_depth && current.size() > 0; ++bounce) {
+		intersect(world, bounce == 0, use_packets);
+		shade(settings, bounce);
+		compact();
+	}
+	// Paths still alive after max_depth bounces contribute nothing.
+	RT_COUNT_N(depth_limit_ends, current.size());
+	RT_COUNT_N(path_lengths[std::min(std::max(settings.max_depth, 0), render_counters::max_path_length)], current.size());
+	current.clear();
+}
+
+void wavefront_integrator::intersect(const hittable& world, bool primary, bool use_packets)
+{
+	const size_t n = current.size();
+	hits.resize(n);
+	found.assign(n, 0);
+	if (primary) RT_COUNT_N(primary_rays, n); else RT_COUNT_N(secondary_rays, n);
+
+	if (primary && use_packets && !packet_starts.empty()) {
+		ray_packet packet;
+		for (size_t p = 0; p < packet_starts.size(); ++p) {
+			size_t begin = packet_starts[p];
+			size_t end = p + 1 < packet_starts.size() ? packet_starts[p + 1] : n;
+			packet.clear();
+			for (size_t i = begin; i < end; ++i) packet.add(current.ray_at(i));
+			packet.prepare();
+			world.hit_packet(packet, 0.001);
+			for (size_t i = begin; i < end; ++i) {
+				found[i] = packet.hit[i - begin];
+				hits[i] = packet.rec[i - begin];
+			}
+		}
+		return;
+	}
+
+	for (size_t i = 0; i < n; ++i)
+		found[i] = world.hit(current.ray_at(i), 0.001, infinity, hits[i]);
+}
+
+void wavefront_integrator::shade(const integrator_settings& settings, int bounce)
+{
+	const size_t n = current.size();
+	alive.assign(n, 0);
+
+	// Misses pick up the background; hits are queued for shading, bucketed by
+	// material kind with a counting sort so each kernel runs over a batch.
+	shade_order.clear();
+	size_t counts[material::kind_count + 1] = {};
+	for (size_t i = 0; i < n; ++i) {
+		if (!found[i]) {
+			radiance[current.path[i]] = current.throughput_at(i) * background_color(current.ray_at(i));
+			RT_COUNT(ray_misses);
+			RT_COUNT_PATH(bounce + 1);
+			continue;
+		}
+		RT_COUNT(ray_hits);
+		counts[static_cast<int>(hits[i].mat_ptr->type) + 1]++;
+	}
+	if (group_by_material) {
+		for (int k = 1; k <= material::kind_count; ++k) counts[k] += counts[k - 1];
+		size_t hit_count = counts[material::kind_count];
+		shade_order.resize(hit_count);
+		for (size_t i = 0; i < n; ++i)
+			if (found[i]) shade_order[counts[static_cast<int>(hits[i].mat_ptr->type)]++] = static_cast<uint32_t>(i);
+	}
+	else {
+		for (size_t i = 0; i < n; ++i)
+			if (found[i]) shade_order.push_back(static_cast<uint32_t>(i));
+	}
+
+	for (uint32_t i : shade_order) {
+		sampler& rng = path_rng[current.path[i]];
+		ray scattered;
+		color attenuation;
+		if (!hits[i].mat_ptr->scatter(current.ray_at(i), hits[i], attenuation, scattered, rng)) {
+			RT_COUNT(absorbed[static_cast<int>(hits[i].mat_ptr->type)]);
+			RT_COUNT_PATH(bounce + 1);
+			continue;
+		}
+		RT_COUNT(scattered[static_cast<int>(hits[i].mat_ptr->type)]);
+		color throughput = current.throughput_at(i) * attenuation;
+
+		if (settings.russian_roulette && bounce + 1 >= settings.min_bounces) {
+			real survival = fmin(real(0.95), fmax(throughput.x(), fmax(throughput.y(), throughput.z())));
+			if (random_double(rng) >= survival) {
+				RT_COUNT(roulette_ends);
+				RT_COUNT_PATH(bounce + 1);
+				continue;
+			}
+			throughput /= survival;
+		}
+
+		// The scattered ray overwrites the slot; compact() gathers the live ones.
+		current.ox[i] = scattered.orig.x(); current.oy[i] = scattered.orig.y(); current.oz[i] = scattered.orig.z();
+		current.dx[i] = scattered.dir.x(); current.dy[i] = scattered.dir.y(); current.dz[i] = scattered.dir.z();
+		current.tr[i] = throughput.x(); current.tg[i] = throughput.y(); current.tb[i] = throughput.z();
+		alive[i] = 1;
+	}
+}
+
+void wavefront_integrator::compact()
+{
+	// Stable, so surviving paths keep their screen order and stay coherent.
+	next.clear();
+	for (size_t i = 0; i < current.size(); ++i) {
+		if (!alive[i]) continue;
+		next.ox.push_back(current.ox[i]); next.oy.push_back(current.oy[i]); next.oz.push_back(current.oz[i]);
+		next.dx.push_back(current.dx[i]); next.dy.push_back(current.dy[i]); next.dz.push_back(current.dz[i]);
+		next.tr.push_back(current.tr[i]); next.tg.push_back(current.tg[i]); next.tb.push_back(current.tb[i]);
+		next.path.push_back(current.path[i]);
+	}
+	std::swap(current, next);
+}
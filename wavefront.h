@@ -0,0 +1,70 @@
+#pragma once
+
+#include "rtweekend.h"
+#include "hittable.h"
+#include "integrator.h"
+
+#include <cstdint>
+#include <vector>
+
+// Breadth-first path tracer. Instead of following one path to the end
+// before starting the next, every queued path advances one bounce per
+// round, stage by stage: intersect all rays, shade all hits grouped by
+// material kind, then compact the survivors into a dense queue for the next
+// bounce. Rays and throughputs live in structure-of-arrays queues.
+//
+// Each path keeps its own sampler and draws from it in the same order as
+// trace_path, so the radiance of every path is bit-identical to the
+// depth-first integrator.
+class wavefront_integrator {
+public:
+	// Starts a group of at most ray_packet::max_size coherent primary rays,
+	// intersected together as a ray_packet when trace() is asked to.
+	void begin_packet() { packet_starts.push_back(static_cast<uint32_t>(path_rng.size())); }
+	// Queues a camera ray. Paths are numbered in the order they are added.
+	void add_path(const ray& r, const sampler& rng);
+	size_t size() const { return path_rng.size(); }
+	void clear();
+
+	// Traces every queued path to completion. With use_packets, primary rays
+	// are intersected per begin_packet() group.
+	void trace(const hittable& world, const integrator_settings& settings, bool use_packets);
+	// Radiance of path i after trace().
+	const color& result(size_t i) const { return radiance[i]; }
+
+	// Shades hits sorted by material kind rather than in queue order.
+	bool group_by_material = true;
+
+private:
+	// One bounce worth of live paths, as parallel arrays.
+	struct path_queue {
+		std::vector<real> ox, oy, oz;
+		std::vector<real> dx, dy, dz;
+		std::vector<real> tr, tg, tb;
+		std::vector<uint32_t> path;
+
+		size_t size() const { return path.size(); }
+		void clear();
+		void resize(size_t n);
+		void push(const ray& r, const color& throughput, uint32_t id);
+		ray ray_at(size_t i) const { return ray(point3(ox[i], oy[i], oz[i]), vec3(dx[i], dy[i], dz[i])); }
+		color throughput_at(size_t i) const { return color(tr[i], tg[i], tb[i]); }
+	};
+
+	void intersect(const hittable& world, bool primary, bool use_packets);
+	void shade(const integrator_settings& settings, int bounce);
+	void compact();
+
+	// Per path, indexed by the number add_path gave it.
+	std::vector<sampler> path_rng;
+	std::vector<color> radiance;
+	std::vector<uint32_t> packet_starts;
+
+	// Per queue slot of the current bounce.
+	path_queue current;
+	path_queue next;
+	std::vector<hit_record> hits;
+	std::vector<uint8_t> found;
+	std::vector<uint8_t> alive;
+	std::vector<uint32_t> shade_order;
+};